@@ -0,0 +1,25 @@
+#ifndef ALLREDUCE_CONST
+#define ALLREDUCE_CONST
+#include <stddef.h>
+#include "libremodel.h"
+
+//Bytes of every rank's buffer reduced at once, which bounds the memory a backend needs whatever the matrix size
+#define ALLREDUCE_CHUNK (1L << 20)
+
+//Seconds the ranks wait for each other to show up before making the group fails
+#define ALLREDUCE_TIMEOUT 60
+
+/**
+ * A group of size processes (ranks) that sum buffers together.
+ *
+ * sum() replaces the len elements at data with their sum over every rank. It is collective: every rank has to call it
+ * with the same len and element type. Both backends add the ranks up in rank order, so every rank gets the same bits.
+ **/
+struct _allreduce{
+    void (*sum)(Allreduce *comm, void *data, long len, char type);
+    void (*close)(Allreduce *comm);
+    void *backend;
+    int rank, size;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef GEMM_CONST
+#define GEMM_CONST
+
+/**
+ * Blocking parameters for the packed GEMM engine.
+ *
+ * GEMM_MR x GEMM_NR is the register tile computed by the micro-kernel (twice as wide for float32, since twice as many fit in a register).
+ * GEMM_KC, GEMM_MC and GEMM_NC size the packed panels of A and B so that they stay in L1/L2/L3 respectively.
+ **/
+#define GEMM_MR 4
+#define GEMM_NR 8
+#define GEMM_NR_F 16
+#define GEMM_KC 256
+#define GEMM_MC 128
+#define GEMM_NC 4096
+
+/**
+ * Describes one GEMM operand: its storage, element type (MATRIX_FLOAT64/MATRIX_FLOAT32), and row/column strides in elements.
+ * Transposed operands are described by swapping the strides instead of copying.
+ **/
+typedef struct _gemm_operand{
+    void *data;
+    long rowStep, colStep;
+    char type;
+} GemmOperand;
+
+GemmOperand gemmOperandOffset(GemmOperand op, long row, long col);
+
+#define GEMM_ACTIV_NONE -1
+
+/**
+ * Work done on each element of C right after its final value is computed, while the tile is still in registers.
+ *
+ * bias (if its data isn't NULL) is added first; zero strides broadcast it, e.g. a column vector over every column.
+ * If out.data isn't NULL, C keeps the biased value and out receives activation(C). Otherwise C itself is activated.
+ * activation is one of the ACTIV_FUNC_* codes or GEMM_ACTIV_NONE. bias and out may be of either element type.
+ **/
+typedef struct _gemm_epilogue{
+    GemmOperand bias;
+    GemmOperand out;
+    int activation;
+} GemmEpilogue;
+
+GemmEpilogue gemmEpilogueOffset(GemmEpilogue epi, long row, long col);
+
+/**
+ * C = beta * C + alpha * (A * B)
+ *
+ * A is m x k, B is k x n and C is m x n. The product is computed in the element type of C;
+ * A and B may be of the other type, in which case they are converted while being packed.
+ **/
+void gemm(int m, int n, int k, double alpha, GemmOperand a, GemmOperand b, double beta, GemmOperand c);
+
+/**
+ * gemm() followed by the epilogue (which may be NULL) on every element of C.
+ **/
+void gemmFused(int m, int n, int k, double alpha, GemmOperand a, GemmOperand b, double beta, GemmOperand c, const GemmEpilogue *epi);
+
+#endif
@@ -0,0 +1,318 @@
+/**
+ * Element type template for the GEMM engine. Only meant to be included by gemm.c, once per element type, with:
+ *
+ *   GEMM_T         the type the product is computed in (the type of C)
+ *   GEMM_TYPE_ID   the matching MATRIX_FLOAT64/MATRIX_FLOAT32 tag
+ *   GEMM_TNR       the micro-kernel tile width for GEMM_T
+ *   GEMM_FN(x)     name mangling for this instantiation
+ *   GEMM_DOT, GEMM_AXPY    the simd kernels for GEMM_T
+ *   GEMM_EXP       exp() for GEMM_T
+ **/
+
+//Per-thread packing buffers. They only grow, so steady state training does not touch the allocator.
+static __thread GEMM_T *GEMM_FN(gemm_pack_a) = NULL, *GEMM_FN(gemm_pack_b) = NULL;
+static __thread long GEMM_FN(gemm_pack_a_len) = 0, GEMM_FN(gemm_pack_b_len) = 0;
+
+/**
+ * Packs the mc x kc block of A into GEMM_MR tall slivers, stored column by column.
+ * Rows past mc are zero filled so the micro-kernel never has to deal with edges.
+ **/
+static void GEMM_FN(gemmPackA)(int mc, int kc, GemmOperand a, GEMM_T *dst){
+    const long rowStep = a.rowStep, colStep = a.colStep;
+    int ir, p;
+
+    for(ir = 0; ir < mc; ir += GEMM_MR){
+        const int mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+
+        if(a.type == GEMM_TYPE_ID && mr == GEMM_MR && rowStep == 1){
+            const GEMM_T *src = (const GEMM_T *) a.data + ir;
+            for(p = 0; p < kc; p++, dst += GEMM_MR){
+                memcpy(dst, src + p * colStep, GEMM_MR * sizeof(GEMM_T));
+            }
+        }else if(a.type == MATRIX_FLOAT32){
+            GEMM_PACK_SLIVER(float, a.data, ir * rowStep, mr, GEMM_MR, rowStep, colStep);
+        }else{
+            GEMM_PACK_SLIVER(double, a.data, ir * rowStep, mr, GEMM_MR, rowStep, colStep);
+        }
+    }
+}
+
+/**
+ * Packs the kc x nc block of B into GEMM_TNR wide slivers, stored row by row.
+ * Columns past nc are zero filled.
+ **/
+static void GEMM_FN(gemmPackB)(int kc, int nc, GemmOperand b, GEMM_T *dst){
+    const long rowStep = b.rowStep, colStep = b.colStep;
+    int jr, p;
+
+    for(jr = 0; jr < nc; jr += GEMM_TNR){
+        const int nr = nc - jr < GEMM_TNR ? nc - jr : GEMM_TNR;
+
+        if(b.type == GEMM_TYPE_ID && nr == GEMM_TNR && colStep == 1){
+            const GEMM_T *src = (const GEMM_T *) b.data + jr;
+            for(p = 0; p < kc; p++, dst += GEMM_TNR){
+                memcpy(dst, src + p * rowStep, GEMM_TNR * sizeof(GEMM_T));
+            }
+        }else if(b.type == MATRIX_FLOAT32){
+            GEMM_PACK_SLIVER(float, b.data, jr * colStep, nr, GEMM_TNR, colStep, rowStep);
+        }else{
+            GEMM_PACK_SLIVER(double, b.data, jr * colStep, nr, GEMM_TNR, colStep, rowStep);
+        }
+    }
+}
+
+/**
+ * Copies a (possibly strided, possibly other-typed) vector into a contiguous GEMM_T buffer.
+ * Returns the original storage when it can be used as is.
+ **/
+static const GEMM_T *GEMM_FN(gemmVector)(const void *data, char type, long step, int len, GEMM_T **buffer, long *bufferLen){
+    int i;
+
+    if(type == GEMM_TYPE_ID && step == 1) return (const GEMM_T *) data;
+
+    GEMM_T *dst = (GEMM_T *) gemmReserve((void **) buffer, bufferLen, len, sizeof(GEMM_T));
+    if(type == MATRIX_FLOAT32){
+        for(i = 0; i < len; i++) dst[i] = (GEMM_T) ((const float *) data)[i * step];
+    }else{
+        for(i = 0; i < len; i++) dst[i] = (GEMM_T) ((const double *) data)[i * step];
+    }
+    return dst;
+}
+
+/**
+ * Register-blocked micro-kernel, instantiated once per instruction set.
+ **/
+static void GEMM_FN(gemmMicroKernel)(int kc, const GEMM_T *restrict a, const GEMM_T *restrict b, GEMM_T *restrict acc){
+    GEMM_MICRO_KERNEL_BODY(GEMM_T, GEMM_TNR)
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2,fma")))
+static void GEMM_FN(gemmMicroKernelAvx2)(int kc, const GEMM_T *restrict a, const GEMM_T *restrict b, GEMM_T *restrict acc){
+    GEMM_MICRO_KERNEL_BODY(GEMM_T, GEMM_TNR)
+}
+
+__attribute__((target("avx512f")))
+static void GEMM_FN(gemmMicroKernelAvx512)(int kc, const GEMM_T *restrict a, const GEMM_T *restrict b, GEMM_T *restrict acc){
+    GEMM_MICRO_KERNEL_BODY(GEMM_T, GEMM_TNR)
+}
+#endif
+
+static void (*GEMM_FN(gemm_micro_kernel))(int, const GEMM_T *restrict, const GEMM_T *restrict, GEMM_T *restrict) = GEMM_FN(gemmMicroKernel);
+
+static void GEMM_FN(gemmSelectKernel)(int level){
+#if defined(__x86_64__) || defined(__i386__)
+    if(level >= SIMD_AVX512){
+        GEMM_FN(gemm_micro_kernel) = GEMM_FN(gemmMicroKernelAvx512);
+    }else if(level >= SIMD_AVX2){
+        GEMM_FN(gemm_micro_kernel) = GEMM_FN(gemmMicroKernelAvx2);
+    }
+#else
+    (void) level;
+#endif
+}
+
+/**
+ * Finishes one element of C: adds the bias, then stores the value and/or its activation.
+ * biasOffset and outOffset locate the element inside the epilogue's bias and out operands.
+ **/
+static inline void GEMM_FN(gemmFinish)(GEMM_T value, GEMM_T *c, const GemmEpilogue *epi, long biasOffset, long outOffset){
+    if(epi->bias.data != NULL) value += (GEMM_T) gemmEpilogueBias(epi, biasOffset);
+
+    GEMM_T activated = value;
+    switch(epi->activation){
+        case ACTIV_FUNC_SIGMOID:
+            activated = 1 / (1 + GEMM_EXP(-value));
+            break;
+        case ACTIV_FUNC_RELU:
+            activated = value < 0 ? 0 : value;
+            break;
+    }
+
+    if(epi->out.data != NULL){
+        *c = value;
+        gemmEpilogueStore(epi, outOffset, activated);
+    }else{
+        *c = activated;
+    }
+}
+
+/**
+ * Writes the valid mr x nr part of a micro-kernel tile into C, applying the epilogue (if any) on the way out.
+ **/
+static void GEMM_FN(gemmStoreTile)(int mr, int nr, const GEMM_T *acc, GEMM_T alpha, GEMM_T beta, GEMM_T *c, long rowStep, long colStep, const GemmEpilogue *epi){
+    int i, j;
+
+    if(epi != NULL){
+        for(i = 0; i < mr; i++, c += rowStep, acc += GEMM_TNR){
+            for(j = 0; j < nr; j++){
+                GEMM_FN(gemmFinish)((beta == 0 ? 0 : beta * c[j * colStep]) + alpha * acc[j], c + j * colStep, epi,
+                                    i * epi->bias.rowStep + j * epi->bias.colStep, i * epi->out.rowStep + j * epi->out.colStep);
+            }
+        }
+    }else if(beta == 0){
+        for(i = 0; i < mr; i++, c += rowStep, acc += GEMM_TNR){
+            for(j = 0; j < nr; j++){
+                c[j * colStep] = alpha * acc[j];
+            }
+        }
+    }else{
+        for(i = 0; i < mr; i++, c += rowStep, acc += GEMM_TNR){
+            for(j = 0; j < nr; j++){
+                c[j * colStep] = beta * c[j * colStep] + alpha * acc[j];
+            }
+        }
+    }
+}
+
+/**
+ * Matrix-vector product (n == 1) for an A of type GEMM_T. A is streamed exactly once, so it is never packed.
+ **/
+static void GEMM_FN(gemv)(int m, int k, GEMM_T alpha, GemmOperand a, GemmOperand b, GEMM_T beta, GEMM_T *c, long cStep, const GemmEpilogue *epi){
+    const GEMM_T *aMat = (const GEMM_T *) a.data;
+    const GEMM_T *x = GEMM_FN(gemmVector)(b.data, b.type, b.rowStep, k, &GEMM_FN(gemm_pack_b), &GEMM_FN(gemm_pack_b_len));
+    int i, p;
+
+    if(a.colStep == 1){
+        //Rows of A are contiguous: one dot product per output
+        for(i = 0; i < m; i++, aMat += a.rowStep, c += cStep){
+            const GEMM_T value = (beta == 0 ? 0 : beta * *c) + alpha * GEMM_DOT(aMat, x, k);
+            if(epi != NULL){
+                GEMM_FN(gemmFinish)(value, c, epi, i * epi->bias.rowStep, i * epi->out.rowStep);
+            }else{
+                *c = value;
+            }
+        }
+        return;
+    }
+
+    //Columns of A are contiguous (A is transposed): accumulate scaled columns into a contiguous buffer
+    GEMM_T *acc = (GEMM_T *) gemmReserve((void **) &GEMM_FN(gemm_pack_a), &GEMM_FN(gemm_pack_a_len), m, sizeof(GEMM_T));
+    memset(acc, 0, m * sizeof(GEMM_T));
+
+    for(p = 0; p < k; p++, aMat += a.colStep){
+        const GEMM_T scale = x[p];
+        if(scale == 0) continue;
+
+        if(a.rowStep == 1){
+            GEMM_AXPY(acc, aMat, scale, m);
+        }else{
+            for(i = 0; i < m; i++){
+                acc[i] += scale * aMat[i * a.rowStep];
+            }
+        }
+    }
+
+    for(i = 0; i < m; i++, c += cStep){
+        const GEMM_T value = (beta == 0 ? 0 : beta * *c) + alpha * acc[i];
+        if(epi != NULL){
+            GEMM_FN(gemmFinish)(value, c, epi, i * epi->bias.rowStep, i * epi->out.rowStep);
+        }else{
+            *c = value;
+        }
+    }
+}
+
+/**
+ * Rank-1 update (k == 1). C is assumed to have contiguous rows, which gemm() arranges by transposing the problem if needed.
+ **/
+static void GEMM_FN(gemmRank1)(int m, int n, GEMM_T alpha, GemmOperand a, GemmOperand b, GEMM_T beta, GEMM_T *c, long cRowStep, long cColStep, const GemmEpilogue *epi){
+    const GEMM_T *x = GEMM_FN(gemmVector)(a.data, a.type, a.rowStep, m, &GEMM_FN(gemm_pack_a), &GEMM_FN(gemm_pack_a_len));
+    const GEMM_T *y = GEMM_FN(gemmVector)(b.data, b.type, b.colStep, n, &GEMM_FN(gemm_pack_b), &GEMM_FN(gemm_pack_b_len));
+    int i, j;
+
+    for(i = 0; i < m; i++, c += cRowStep){
+        const GEMM_T scale = alpha * x[i];
+
+        if(epi != NULL){
+            for(j = 0; j < n; j++){
+                GEMM_FN(gemmFinish)((beta == 0 ? 0 : beta * c[j * cColStep]) + scale * y[j], c + j * cColStep, epi,
+                                    i * epi->bias.rowStep + j * epi->bias.colStep, i * epi->out.rowStep + j * epi->out.colStep);
+            }
+        }else if(beta == 0){
+            for(j = 0; j < n; j++){
+                c[j * cColStep] = scale * y[j];
+            }
+        }else if(beta == 1 && cColStep == 1){
+            GEMM_AXPY(c, y, scale, n);
+        }else{
+            for(j = 0; j < n; j++){
+                c[j * cColStep] = beta * c[j * cColStep] + scale * y[j];
+            }
+        }
+    }
+}
+
+static void GEMM_FN(gemmCompute)(int m, int n, int k, GEMM_T alpha, GemmOperand a, GemmOperand b, GEMM_T beta, GemmOperand c, const GemmEpilogue *epi){
+    GEMM_T *cMat = (GEMM_T *) c.data;
+    const long cRowStep = c.rowStep, cColStep = c.colStep;
+
+    if(k <= 0){
+        int i, j;
+        for(i = 0; i < m; i++){
+            for(j = 0; j < n; j++){
+                const GEMM_T value = beta == 0 ? 0 : beta * cMat[i * cRowStep + j * cColStep];
+                if(epi != NULL){
+                    GEMM_FN(gemmFinish)(value, cMat + i * cRowStep + j * cColStep, epi,
+                                        i * epi->bias.rowStep + j * epi->bias.colStep, i * epi->out.rowStep + j * epi->out.colStep);
+                }else{
+                    cMat[i * cRowStep + j * cColStep] = value;
+                }
+            }
+        }
+        return;
+    }
+
+    if(n == 1 && a.type == GEMM_TYPE_ID){
+        GEMM_FN(gemv)(m, k, alpha, a, b, beta, cMat, cRowStep, epi);
+        return;
+    }
+
+    if(k == 1){
+        GEMM_FN(gemmRank1)(m, n, alpha, a, b, beta, cMat, cRowStep, cColStep, epi);
+        return;
+    }
+
+    const int ncMax = (n < GEMM_NC ? n : GEMM_NC) + GEMM_TNR;
+    const int mcMax = (m < GEMM_MC ? m : GEMM_MC) + GEMM_MR;
+    const int kcMax = k < GEMM_KC ? k : GEMM_KC;
+    GEMM_T *packB = (GEMM_T *) gemmReserve((void **) &GEMM_FN(gemm_pack_b), &GEMM_FN(gemm_pack_b_len), (long) kcMax * ncMax, sizeof(GEMM_T));
+    GEMM_T *packA = (GEMM_T *) gemmReserve((void **) &GEMM_FN(gemm_pack_a), &GEMM_FN(gemm_pack_a_len), (long) kcMax * mcMax, sizeof(GEMM_T));
+    GEMM_T acc[GEMM_MR * GEMM_TNR];
+
+    int jc, pc, ic, jr, ir;
+    for(jc = 0; jc < n; jc += GEMM_NC){
+        const int nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+
+        for(pc = 0; pc < k; pc += GEMM_KC){
+            const int kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+            //Only the first pass over k applies beta; the others accumulate onto what it wrote. The epilogue waits for the last one.
+            const GEMM_T betaEff = pc ? 1 : beta;
+            const char last = pc + kc >= k;
+
+            GEMM_FN(gemmPackB)(kc, nc, gemmOperandOffset(b, pc, jc), packB);
+
+            for(ic = 0; ic < m; ic += GEMM_MC){
+                const int mc = m - ic < GEMM_MC ? m - ic : GEMM_MC;
+
+                GEMM_FN(gemmPackA)(mc, kc, gemmOperandOffset(a, ic, pc), packA);
+
+                for(jr = 0; jr < nc; jr += GEMM_TNR){
+                    const int nr = nc - jr < GEMM_TNR ? nc - jr : GEMM_TNR;
+
+                    for(ir = 0; ir < mc; ir += GEMM_MR){
+                        const int mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+
+                        GEMM_FN(gemm_micro_kernel)(kc, packA + ir * kc, packB + jr * kc, acc);
+                        if(last && epi != NULL){
+                            const GemmEpilogue tileEpi = gemmEpilogueOffset(*epi, ic + ir, jc + jr);
+                            GEMM_FN(gemmStoreTile)(mr, nr, acc, alpha, betaEff, cMat + (ic + ir) * cRowStep + (jc + jr) * cColStep, cRowStep, cColStep, &tileEpi);
+                        }else{
+                            GEMM_FN(gemmStoreTile)(mr, nr, acc, alpha, betaEff, cMat + (ic + ir) * cRowStep + (jc + jr) * cColStep, cRowStep, cColStep, NULL);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -1,9 +1,23 @@
 #ifndef MATRIX_CONST
 #define MATRIX_CONST
 
+//Fused optimizer update kernels
+#define MATRIX_UPDATE_MOMENTUM 0
+#define MATRIX_UPDATE_RMSPROP 1
+#define MATRIX_UPDATE_ADAM 2
+#define MATRIX_UPDATE_SGD 3
+
+//Byte alignment of the storage and of every padded row (one cache line, one AVX-512 register)
+#define MATRIX_ALIGN 64
+
 struct _matrix{
-    double *mat, *matEnd, *matIter;
+    double *mat;    /*Storage when type == MATRIX_FLOAT64*/
+    float *fmat;    /*Storage when type == MATRIX_FLOAT32*/
     int n, m;
+    int ld;         /*Leading dimension: elements between the starts of two consecutive rows (>= m)*/
+    int iter;       /*Index of the next element returned by matrixGetNext*/
+    char type;
+    char owner;     /*1 if the storage belongs to this Matrix, 0 for a view into another Matrix's storage*/
 };
 
 #endif
@@ -0,0 +1,32 @@
+#ifndef SIMD_CONST
+#define SIMD_CONST
+
+//Vector instruction sets, ordered from narrowest to widest
+#define SIMD_SCALAR 0
+#define SIMD_SSE2 1
+#define SIMD_AVX2 2
+#define SIMD_AVX512 3
+
+/**
+ * Table of contiguous kernels (double, then float). It is filled once at load time with the widest
+ * implementation the host CPU (and OS) supports.
+ **/
+typedef struct _simd_kernels{
+    double (*dot)(const double *a, const double *b, long len);
+    void (*axpy)(double *y, const double *x, double scale, long len); /*y += scale * x*/
+    void (*add)(double *a, double value, long len);
+    void (*mul)(double *a, double value, long len);
+    void (*set)(double *a, double value, long len);
+    float (*dotF)(const float *a, const float *b, long len);
+    void (*axpyF)(float *y, const float *x, float scale, long len);
+    void (*addF)(float *a, float value, long len);
+    void (*mulF)(float *a, float value, long len);
+    void (*setF)(float *a, float value, long len);
+    int level;
+} SimdKernels;
+
+extern SimdKernels simd;
+
+int simdDetectLevel(void);
+
+#endif
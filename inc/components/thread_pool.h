@@ -0,0 +1,18 @@
+#ifndef THREAD_POOL_CONST
+#define THREAD_POOL_CONST
+
+/**
+ * Splits the index range [0, total) into contiguous parts and runs task(arg, start, end) on each part,
+ * using the persistent worker threads plus the calling thread. Returns once every part is done.
+ *
+ * Runs everything on the calling thread when the pool has one thread, when it is already busy with another
+ * dispatch, or when called from inside a pool task, so nested or concurrent use can never deadlock.
+ **/
+void threadPoolRun(void (*task)(void *, int, int), void *arg, int total);
+
+/**
+ * Whether an operation of the given size (scalar operations) should be split across the pool.
+ **/
+char threadPoolWorthIt(double work);
+
+#endif
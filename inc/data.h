@@ -4,6 +4,7 @@
 
 typedef struct{
     List *feats, *cls, *uFeats;
+    Matrix *featMat;    /*Storage shared by the views in feats once binTransform has run (NULL before)*/
     int numEntries;
 } Data;
 
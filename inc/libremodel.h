@@ -51,28 +51,82 @@ void nulled_matrix_destroy(void *matrix);
 #define MATRIX_RESULT_ADD 8 /*Operation modified to have the result added to C*/
 #define MATRIX_RESULT_SUB 16    /*Operation modified to have the result subtracted from C*/
 
+#define MATRIX_FLOAT64 0    /*Elements stored as double*/
+#define MATRIX_FLOAT32 1    /*Elements stored as float*/
+
+#define MATRIX_MAP_COPY 0           /*c = a*/
+#define MATRIX_MAP_SIGMOID 1        /*c = 1 / (1 + e^-a)*/
+#define MATRIX_MAP_RELU 2           /*c = max(a, 0)*/
+#define MATRIX_MAP_DER_SIGMOID 3    /*c = a * (1 - a), the sigmoid derivative given the sigmoid output*/
+#define MATRIX_MAP_DER_RELU 4       /*c = a < 0 ? 0 : 1*/
+#define MATRIX_MAP_EXP 5            /*c = e^a*/
+#define MATRIX_MAP_SQUARE 6         /*c = a * a*/
+#define MATRIX_MAP_SQRT 7           /*c = sqrt(a)*/
+
+#define MATRIX_ZIP_ADD 0    /*c = a + b*/
+#define MATRIX_ZIP_SUB 1    /*c = a - b*/
+#define MATRIX_ZIP_MUL 2    /*c = a * b (Hadamard product)*/
+#define MATRIX_ZIP_DIV 3    /*c = a / b*/
+#define MATRIX_ZIP_DER_SIGMOID 4    /*c = a * b * (1 - b), a gradient through a sigmoid whose output is b*/
+#define MATRIX_ZIP_DER_RELU 5       /*c = b < 0 ? 0 : a, a gradient through a relu whose input is b*/
+
 //Opaque Struct
 typedef struct _matrix Matrix;
 
 //Matrix Creator/Destroyer
 Matrix *matrixCreate(int n, int m, double *values, int valuesLen);
-double *matrixDestroy(Matrix *matrix, char flags);
+Matrix *matrixCreateF(int n, int m, float *values, int valuesLen);
+Matrix *matrixConvert(Matrix *a, Matrix *c, char type);  /*Copies a into c (created with the given type if NULL)*/
+void *matrixDestroy(Matrix *matrix, char flags);
 
-//Instance Functions
+//Views (share the parent's storage, so they must not outlive it; destroy them with matrixDestroy as usual)
+Matrix *matrixView(Matrix *parent, int row, int col, int n, int m);    /*The n x m block starting at [row,col]*/
+Matrix *matrixViewRows(Matrix *parent, int row, int n, int step);     /*n rows starting at row, taking every step-th one*/
+Matrix *matrixViewVector(Matrix *parent, int row);                    /*Row row as an m x 1 column vector*/
+Matrix *matrixViewMove(Matrix *view, Matrix *parent, int row, int col, int n, int m);    /*Points an existing view at another block, like matrixView() without allocating*/
+
+//Arenas: one contiguous matrix (e.g. 1 x N) carved into aligned blocks that are each laid out like a matrix of their own
+long matrixArenaSize(int n, int m, char type);   /*Elements an n x m block takes, padding included*/
+Matrix *matrixViewArena(Matrix *arena, long offset, int n, int m);   /*The n x m block at element offset (a multiple of earlier matrixArenaSize() results)*/
+
+//Raw storage (e.g. a mapped file): rows laid out like matrixCreate() lays them out, padding included
+Matrix *matrixViewMemory(void *values, int n, int m, char type);  /*n x m view of MATRIX_ALIGN aligned storage the caller keeps and frees*/
+long matrixWriteRaw(Matrix *a, FILE *file);     /*Writes a's rows in that layout, returning the bytes written (-1 on failure)*/
+long matrixReadRaw(Matrix *a, FILE *file);      /*Reads rows written by matrixWriteRaw() into a, which must have the same shape and type*/
+
+//Instance Functions (operands may mix element types; results are computed in the type of c)
 Matrix *matrixMul(Matrix *a, Matrix *b, Matrix *c, char flags);
+Matrix *matrixReduceCols(Matrix *a, Matrix *c, char flags);   /*c (n x 1) = the sum of a's columns, honoring MATRIX_RESULT_ADD/SUB*/
+Matrix *matrixMulBiasActivate(Matrix *w, Matrix *x, Matrix *bias, Matrix *z, Matrix *a, int activation);  /*z = w * x + bias (a column is broadcast), a = activation(z) in one pass. z may be NULL.*/
 Matrix *matrixAdd(Matrix *a, Matrix *b, Matrix *c, char flags);
 Matrix *matrixSub(Matrix *a, Matrix *b, Matrix *c, char flags);
 void matrixConstantAdd(Matrix *a, double c);
 void matrixConstantMul(Matrix *a, double c);
 
+//Elementwise (every operand has the same shape; c is created like a if NULL, and may be a or b)
+Matrix *matrixMap(Matrix *a, Matrix *c, int op);              /*c = op(a) with a MATRIX_MAP_* op*/
+void matrixMapInPlace(Matrix *a, int op);
+Matrix *matrixZip(Matrix *a, Matrix *b, Matrix *c, int op);   /*c = a op b with a MATRIX_ZIP_* op*/
+void matrixZipInPlace(Matrix *a, Matrix *b, int op);           /*a = a op b*/
+
+//Fused optimizer updates: one pass over w, the descent direction g and the moments (all the same shape and type).
+//With a shadow (else NULL), w and the moments are float64 while g is float32, and the float32 shadow gets the new w in the same pass.
+void matrixSGDUpdate(Matrix *w, Matrix *g, double rate, Matrix *shadow);   /*w += rate * g*/
+void matrixMomentumUpdate(Matrix *w, Matrix *velocity, Matrix *g, double momentum, double rate, Matrix *shadow);   /*v = momentum * v + g; w += rate * v*/
+void matrixRMSPropUpdate(Matrix *w, Matrix *square, Matrix *g, double decay, double rate, double eps, Matrix *shadow);    /*s = decay * s + (1 - decay) * g^2; w += rate * g / (sqrt(s) + eps)*/
+void matrixAdamUpdate(Matrix *w, Matrix *mean, Matrix *square, Matrix *g, double beta1, double beta2, double rate, double eps, long step, Matrix *shadow);  /*Adam with bias correction, step counts from 1*/
+
 double dotProd(double *a, long stepA, double *b, long stepB, double *aStop);
 
 int matrixGetM(Matrix *a);
 int matrixGetN(Matrix *a);
+char matrixGetType(Matrix *a);
 double matrixGetValue(Matrix *a, int n, int m);
 double matrixGetNext(Matrix *a, int index);
+int matrixNonZeroRows(Matrix *a, int *rows);   /*Fills rows (n long) with the indices of the rows holding a non-zero element, returning how many*/
 
 void matrixSetMat(Matrix *a, double num);
+void matrixFillUniform(Matrix *a, double low, double high, unsigned long seed, unsigned long stream);  /*Uniform in [low, high). Element [i,j] only depends on seed, stream and i * m + j, so it's the same for any thread count.*/
 void matrixSetValue(Matrix *a, int n, int m, double value);
 void matrixSetPrevious(Matrix *a, double value);
 void matrixResetIter(Matrix *a);
@@ -80,6 +134,36 @@ void matrixResetIter(Matrix *a);
 void matrixPrint(Matrix *a);
 void matrixPrintJSON(Matrix *a, FILE *output);
 
+//Parallelism
+void matrixSetParallelThreshold(long work);  /*Operations (multiply-adds or elements) below this stay on the calling thread*/
+
+
+/**
+ * Thread_pool.c functions
+ **/
+
+//Pool Size (defaults to the number of online cores, 1 keeps everything on the calling thread)
+void threadPoolSetSize(int threads);
+int threadPoolGetSize();
+
+
+/**
+ * Allreduce.c functions
+ **/
+
+//Opaque Struct
+typedef struct _allreduce Allreduce;
+
+//Allreduce Creator/Destroyer (every rank of a group calls them; rank runs from 0 to size - 1, and NULL comes back if the others don't show up within a minute)
+Allreduce *allreduceCreateShm(const char *name, int rank, int size);   /*Processes on one host, meeting at the POSIX shared memory object name (e.g. "/job")*/
+Allreduce *allreduceCreateTcp(const char *host, int port, int rank, int size);   /*Rank 0 listens on port, the others connect to it at host*/
+void allreduceDestroy(Allreduce *comm);
+
+//Instance Functions (collective: every rank makes the same calls, in the same order, with matrices of the same shape and type)
+void allreduceAverage(Allreduce *comm, Matrix *a);   /*a = the mean of a over every rank, bit for bit the same on all of them*/
+int allreduceGetRank(Allreduce *comm);
+int allreduceGetSize(Allreduce *comm);
+
 
 /**
  * Neural Solver functions
@@ -89,7 +173,11 @@ void matrixPrintJSON(Matrix *a, FILE *output);
 typedef struct _neural_network_solver NeuralNetworkSolver;
 
 NeuralNetworkSolver *neural_network_solver_sgd(double alpha, double rate);
-//Add more when created like Momentum or RMSProp?
+NeuralNetworkSolver *neural_network_solver_momentum(double alpha, double rate);    /*alpha is the momentum coefficient*/
+NeuralNetworkSolver *neural_network_solver_rmsprop(double alpha, double rate);     /*alpha (below 1) is the decay of the mean squared gradient*/
+NeuralNetworkSolver *neural_network_solver_adam(double alpha, double beta, double rate);  /*alpha and beta (below 1) decay the gradient's mean and mean square (e.g. .9 and .999)*/
+void neural_network_solver_set_type(NeuralNetworkSolver *solver, char type);   /*MATRIX_FLOAT64 (default) or MATRIX_FLOAT32, before adding layers*/
+void neural_network_solver_set_mixed_precision(NeuralNetworkSolver *solver);    /*float32 layers, but float64 master weights and moments taking the updates (before adding layers)*/
 
 /**
  * Neural.c functions
@@ -100,6 +188,32 @@ NeuralNetworkSolver *neural_network_solver_sgd(double alpha, double rate);
 #define ACTIV_FUNC_RELU 1
 //Add more when created
 
+#define NEURAL_PARALLEL_NONE 0      /*Batches one after another, each spread over the thread pool (default)*/
+#define NEURAL_PARALLEL_HOGWILD 1   /*Workers train on their own share of each round and update the shared weights without locks*/
+#define NEURAL_PARALLEL_DATA 2      /*Workers split every batch, then their gradients are summed up for one update (bitwise reproducible for a given worker count)*/
+#define NEURAL_PARALLEL_PIPELINE 3  /*Each worker runs a group of layers, with every batch streamed through them in micro-batches*/
+
+#define NEURAL_ALLREDUCE_GRADIENTS 1    /*Processes average their gradients before every update, training like one process on all their batches*/
+#define NEURAL_ALLREDUCE_PARAMETERS 2   /*Processes update on their own and average their parameters every period updates*/
+
+#define NEURAL_CHECKPOINT_EPOCHS 0   /*Checkpoint periods count rounds over the training set*/
+#define NEURAL_CHECKPOINT_SAMPLES 1  /*Checkpoint periods count samples trained on (taken at the next batch boundary)*/
+
+#define NEURAL_PROFILE_FORWARD 0    /*z = w * a + b and a = f(z)*/
+#define NEURAL_PROFILE_DZ 1         /*dz = da * f'(z)*/
+#define NEURAL_PROFILE_DA 2         /*The previous layer's da = w^T * dz*/
+#define NEURAL_PROFILE_DW_DB 3      /*dw = dz * a^T and db = the sum of dz (SGD applies them to w and b right there)*/
+#define NEURAL_PROFILE_UPDATE 4     /*The optimizer's pass over every parameter (whole network only)*/
+#define NEURAL_PROFILE_KERNELS 5
+
+//What profiling measured of one kernel
+typedef struct _neural_profile{
+    double seconds;     /*Wall time (summed over the workers of the parallel modes)*/
+    double flops;       /*Floating point operations*/
+    double bytes;       /*Bytes of the operands read and written, each counted once*/
+    long calls;
+} NeuralProfile;
+
 //Opaque Struct
 typedef struct _neural_network NeuralNetwork;
 
@@ -107,12 +221,46 @@ typedef struct _neural_network NeuralNetwork;
 NeuralNetwork *neural_network_create(NeuralNetworkSolver *solver, char file_flag, char *filename, int seed);
 void neural_network_destroy(NeuralNetwork *network);
 
+//Model files (versioned binary, with the weights laid out as in memory)
+char neural_network_save(NeuralNetwork *network, char *filename);  /*Writes the layers and weights, replacing filename in one step*/
+NeuralNetwork *neural_network_load(char *filename);  /*Maps the file read only: an inference-only network that shares the file's pages instead of copying them*/
+void neural_network_freeze(NeuralNetwork *network);    /*Makes a trained network inference-only like a loaded one, freeing its activations, gradients and optimizer state*/
+
 //Instance Functions
 char neural_network_add_input_layer(NeuralNetwork *network, int size);
 char neural_network_add_hidden_layer(NeuralNetwork *network, int size, int activation_function_flag);
 char neural_network_add_output_layer(NeuralNetwork *network, int size);
+void neural_network_set_batch_size(NeuralNetwork *network, int batch_size);    /*Samples per weight update (default 1)*/
+void neural_network_set_max_epochs(NeuralNetwork *network, int epochs);     /*Rounds over the training set at most (default 100)*/
+void neural_network_set_early_stopping(NeuralNetwork *network, List *x, List *y, double tolerance, int patience);  /*Checks x/y (NULL for none) after every round, stops once its loss hasn't dropped by tolerance for patience rounds and keeps the best weights*/
+void neural_network_set_parallel(NeuralNetwork *network, char mode, int workers);   /*NEURAL_PARALLEL_* mode, with workers (pipeline stages) < 1 using one per pool thread*/
+void neural_network_set_allreduce(NeuralNetwork *network, Allreduce *comm, char mode, int period);  /*NEURAL_ALLREDUCE_* mode over comm (NULL to stop), which the caller keeps and destroys*/
+void neural_network_set_checkpoint(NeuralNetwork *network, char *filename, int period, char unit);  /*Saves the training state to filename (one per process) every period NEURAL_CHECKPOINT_* units, from a background thread. NULL stops.*/
+
+//Profiling (of the layers there are when it starts)
+void neural_network_set_profiling(NeuralNetwork *network, char enabled);   /*Starts over from zero, or stops*/
+char neural_network_get_profile(NeuralNetwork *network, int layer, int kernel, NeuralProfile *profile);  /*A NEURAL_PROFILE_* kernel of layer (1 for the first hidden one), or of the whole network for layer 0*/
+void neural_network_print_profile(NeuralNetwork *network, FILE *output);    /*Time, calls, GFLOP/s and GB/s of every kernel*/
 
 void neural_network_train(NeuralNetwork *network, List *x, List *y);
-List *neural_network_classify(NeuralNetwork *network, List *input);
+char neural_network_resume(NeuralNetwork *network, char *filename, List *x, List *y);   /*Trains on from the checkpoint in filename, made by a network built the same way on the same x and y*/
+
+//Inference, allocating nothing once the network has seen a batch as wide (classes of output r >= .5 have bit r set)
+Matrix *neural_network_predict(NeuralNetwork *network, Matrix *input);  /*Outputs for input's columns (samples), a view valid until the next call*/
+char neural_network_classify_matrix(NeuralNetwork *network, Matrix *input, int *classes);  /*Class of each of input's columns*/
+char neural_network_classify(NeuralNetwork *network, List *input, int *classes);    /*Class of each n x 1 sample, classes being as long as input*/
+
+/**
+ * Inference contexts hold only the activations of one caller, reading the weights of the network they were made from,
+ * so any number of threads can each run their own against one network at the same time (as long as nothing trains it
+ * or adds layers meanwhile). The neural_network_* inference functions above use one the network owns, for one thread.
+ **/
+typedef struct _neural_context NeuralContext;
+
+NeuralContext *neural_context_create(NeuralNetwork *network);  /*NULL before the network has layers. Destroy it before the network.*/
+void neural_context_destroy(NeuralContext *context);
+Matrix *neural_context_predict(NeuralContext *context, Matrix *input);
+char neural_context_classify_matrix(NeuralContext *context, Matrix *input, int *classes);
+char neural_context_classify(NeuralContext *context, List *input, int *classes);
 
 #endif
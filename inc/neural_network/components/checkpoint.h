@@ -0,0 +1,36 @@
+#ifndef _NEURAL_CHECKPOINT_CONST_
+#define _NEURAL_CHECKPOINT_CONST_
+#include "libremodel.h"
+
+//Everything training needs to carry on where it was
+typedef struct _neural_checkpoint{
+    Matrix *params;         /*Parameter arena (the float64 master weights in mixed precision)*/
+    Matrix *moments[2];     /*Optimizer state laid out like params (NULL if the solver keeps none)*/
+    Matrix *best;           /*Best parameters the validation set has seen (NULL if none yet)*/
+    int *order;             /*Sample order of the current round*/
+    long steps;             /*Weight updates done*/
+    double best_loss;
+    int samples;            /*Size of the training set, and of order*/
+    int epoch;              /*Rounds finished*/
+    int position;           /*Samples of the current round already trained on (0 between rounds)*/
+    int stale;              /*Rounds since the validation loss last dropped*/
+    unsigned int shuffle;   /*rand_r() state drawing the sample orders*/
+} NeuralCheckpoint;
+
+void checkpoint_clear(NeuralCheckpoint *checkpoint);   /*Frees what it holds, leaving it empty*/
+char checkpoint_write(NeuralCheckpoint *checkpoint, char *filename);   /*Replaces filename with checkpoint in one step*/
+char checkpoint_read(NeuralCheckpoint *checkpoint, char *filename);    /*Fills an empty checkpoint from filename*/
+
+/**
+ * Writes checkpoints to one file from a thread of its own, through two snapshots: training fills one while the other is
+ * on its way to disk, so it only ever waits for a memory copy. A snapshot still waiting when the next one is filled is
+ * simply replaced by it, since only the latest checkpoint matters.
+ **/
+typedef struct _neural_checkpoint_writer NeuralCheckpointWriter;
+
+NeuralCheckpointWriter *checkpoint_writer_create(char *filename);
+NeuralCheckpoint *checkpoint_writer_acquire(NeuralCheckpointWriter *writer);   /*A snapshot to fill, never the one being written*/
+void checkpoint_writer_submit(NeuralCheckpointWriter *writer);    /*Hands the acquired snapshot over to be written*/
+void checkpoint_writer_destroy(NeuralCheckpointWriter *writer);   /*Returns once everything submitted is on disk*/
+
+#endif
@@ -11,15 +11,86 @@ NeuralNetworkSolver *sgd_solver_create(double alpha, double rate);
 
 char hidden_solver_check_valid(NeuralNetworkHiddenSolver *solver);
 
+void solver_set_batch_size(NeuralNetworkSolver *solver, int batch_size);
+void solver_set_seed(NeuralNetworkSolver *solver, unsigned long seed);    /*Seed of the weights of layers added from now on*/
+
 
 void generic_add_input_layer(NeuralNetworkSolver *solver, int size);
 void generic_add_hidden_layer(NeuralNetworkSolver *solver, int size, int activation_function_flag);
 void generic_add_output_layer(NeuralNetworkSolver *solver, int size);
+void generic_layer_set_columns(void *target, int columns, int batch_size);
 
 int solver_get_num_layers(NeuralNetworkSolver *solver);
 int solver_get_layer_n_val(NeuralNetworkSolver *solver, int layer_number);
-int solver_get_layer_m_val(NeuralNetworkSolver *solver, int layer_number);
-Matrix *solver_get_output_layer(NeuralNetworkSolver *solver);
+Matrix *solver_get_output_layer(NeuralNetworkSolver *solver);    /*Output of the last forward pass, NULL once frozen (see solver_infer())*/
+Matrix *solver_get_parameters(NeuralNetworkSolver *solver);    /*1 x N arena holding every layer's w and b back to back*/
+Matrix *solver_get_gradients(NeuralNetworkSolver *solver);     /*Same layout, holding dw and db*/
+
+//What a replica's back propagation does with its gradients
+#define SOLVER_REPLICA_SHARED 0     /*Applies them to the shared parameters right away, like the solver itself*/
+#define SOLVER_REPLICA_GRADIENTS 1  /*Only leaves their (unaveraged) sum over its samples in its gradient arena*/
+#define SOLVER_REPLICA_ACCUMULATE 2 /*Only adds that sum to the gradient arena of the solver it was made from*/
+
+/**
+ * A worker copy of the solver: its own activation buffers and gradient arena, but w, b and the optimizer state shared with solver.
+ * Destroy it with solver_destroy() before the solver it was made from.
+ **/
+NeuralNetworkSolver *solver_replica_create(NeuralNetworkSolver *solver, char mode);
+
+/**
+ * Forward propagation through layers [from, to) only. input is only read when from is 0; later layers start from the output of layer from - 1.
+ **/
+void solver_forward_range(NeuralNetworkSolver *solver, Matrix *input, int from, int to);
+
+/**
+ * Back propagation through layers [from, to) only, after the forward pass of the same samples. y is only read when to is the
+ * number of layers and input only when from is 0. The da of layer from - 1 is updated, so its own backward pass can follow.
+ **/
+void solver_backward_range(NeuralNetworkSolver *solver, Matrix *input, Matrix *y, int from, int to);
+
+/**
+ * One optimizer step with grads (laid out like the parameter arena) holding the gradients summed over columns samples.
+ * grads is scaled in place.
+ **/
+void solver_apply_gradients(NeuralNetworkSolver *solver, Matrix *grads, int columns);
+
+/**
+ * Trains together with the other processes of comm (NULL to train alone), averaging what the NEURAL_ALLREDUCE_* mode says:
+ * the gradients before every update, or the parameters after every period updates.
+ **/
+void solver_set_allreduce(NeuralNetworkSolver *solver, Allreduce *comm, char mode, int period);
+void solver_average_parameters(NeuralNetworkSolver *solver);   /*Averages the parameters right away, if comm averages parameters at all*/
+
+Matrix *solver_copy_parameters(NeuralNetworkSolver *solver, Matrix *copy);  /*Copies the parameters (the master weights in mixed precision) into copy, created if NULL*/
+void solver_restore_parameters(NeuralNetworkSolver *solver, Matrix *copy);
+Matrix *solver_copy_moment(NeuralNetworkSolver *solver, int moment, Matrix *copy);  /*Copies optimizer moment 0 (mean) or 1 (mean square) into copy, created if NULL (copy as is if the solver keeps none)*/
+void solver_restore_moment(NeuralNetworkSolver *solver, int moment, Matrix *copy);
+char solver_has_moment(NeuralNetworkSolver *solver, int moment);   /*Whether the solver keeps optimizer moment 0 or 1*/
+long solver_get_steps(NeuralNetworkSolver *solver);     /*Weight updates so far (Adam's bias correction depends on it)*/
+void solver_set_steps(NeuralNetworkSolver *solver, long steps);
+double solver_allreduce_value(NeuralNetworkSolver *solver, double value);    /*The mean of value over the processes training together*/
+
+char solver_is_frozen(NeuralNetworkSolver *solver);     /*Inference only, holding no buffers to train with*/
+void solver_freeze(NeuralNetworkSolver *solver);    /*Frees all but the layers' w and b for good: activations, gradients, master weights and optimizer state*/
+char solver_save(NeuralNetworkSolver *solver, FILE *file);     /*Writes the layers and parameters as a model file*/
+NeuralNetworkSolver *solver_load(char *filename);   /*A frozen solver whose w and b are views of the mapped model file*/
+
+void solver_set_profiling(NeuralNetworkSolver *solver, char enabled);
+char solver_get_profile(NeuralNetworkSolver *solver, int layer, int kernel, NeuralProfile *profile);   /*Layer 0 is the whole network*/
+
+/**
+ * Forward-only buffers for running batches through the solver's layers: two activation matrices as tall as the widest layer
+ * that the layers write to in turn, and a matrix to pack listed samples into. They are only reallocated when a batch has more
+ * columns than any before it (or layers were added), so repeated calls allocate nothing.
+ **/
+typedef struct _solver_inference SolverInference;
+
+SolverInference *solver_inference_create(NeuralNetworkSolver *solver, int capacity);  /*Buffers for capacity columns, NULL before there are layers*/
+Matrix *solver_inference_pack(NeuralNetworkSolver *solver, SolverInference *inference, List *input, int from, int count);  /*Copies count n x 1 samples into the packed input, returned*/
+Matrix *solver_infer(NeuralNetworkSolver *solver, SolverInference *inference, Matrix *input);   /*Output of the last layer for input's columns, a view valid until the next call*/
+void solver_inference_destroy(SolverInference *inference);
+
+void solver_destroy(NeuralNetworkSolver *solver);
 #endif
 
 
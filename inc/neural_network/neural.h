@@ -7,12 +7,31 @@ struct _neural_network{
     FILE *logFile;
     NeuralNetworkSolver *solver;
     void (*activation_function)(Matrix *, Matrix *);
-    Matrix *(*d_activation_function)(Matrix *, Matrix *);
+    void (*d_activation_function)(Matrix *, Matrix *, Matrix *, Matrix *);
     double (*loss_function)(Matrix *, Matrix *);
     void (*d_loss_function)(Matrix *, Matrix *, Matrix *);
+    int batch_size;
+    int max_epochs;
+    List *valid_x, *valid_y;    /*Held out samples checked after every round (NULL for none)*/
+    double tolerance;   /*Smallest drop of the validation loss that counts as progress*/
+    int patience;       /*Rounds without progress before training stops (< 1 to never stop early)*/
+    char *checkpoint;       /*File training snapshots are written to (NULL for none)*/
+    int checkpoint_period;  /*Rounds or samples between them*/
+    char checkpoint_unit;   /*NEURAL_CHECKPOINT_* the period counts*/
+    unsigned int shuffle;   /*rand_r() state drawing the sample order of every round*/
+    struct _neural_checkpoint *resume;  /*State the next training run starts from (set by neural_network_resume() only)*/
+    int workers;    /*Training threads of the parallel mode, < 1 for one per pool thread*/
+    NeuralContext *context; /*Where neural_network_predict() and classify run (NULL until first used)*/
+    char parallel;  /*NEURAL_PARALLEL_* training mode*/
     char log;
 };
 
+//Activation scratch of one thread running a network, which only reads the network's weights
+struct _neural_context{
+    NeuralNetwork *network;
+    struct _solver_inference *inference;
+};
+
 typedef struct _neural_network_hidden_solver NeuralNetworkHiddenSolver;
 
 struct _neural_network_solver{
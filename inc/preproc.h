@@ -2,6 +2,6 @@
 #define PREPROC_CONST
 
 Data *extractData(char *filename);
-int binTransform(Data *data, float low, float high);
+int binTransform(Data *data, float low, float high, char type);
 
 #endif
\ No newline at end of file
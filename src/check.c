@@ -0,0 +1,208 @@
+/**
+ * Checks of the guarantees the library makes that nothing else would notice breaking: data-parallel training ending on
+ * the same bits whatever the pool size, model files predicting like the network they were saved from, and both allreduce
+ * backends handing every rank the same average. Built next to main.exe; make check runs it.
+ *
+ * Author: Fabio Hux
+ *
+ * Date Created: October 2026
+ *
+ * Date Last Edited: 10/17/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <libremodel.h>
+#include "neural_network/neural.h"
+#include "neural_network/components/solver.h"
+
+#define CHECK_SAMPLES 96
+#define CHECK_INPUTS 12
+#define CHECK_MODEL "/tmp/nnc_check_model.bin"
+#define CHECK_SHM "/nnc_check"
+#define CHECK_PORT 47917
+
+/**
+ * The bytes matrixWriteRaw() lays a out as, to compare two matrices bit for bit. Free the result.
+ **/
+char *checkRawBytes(Matrix *a, size_t *size){
+    char *bytes = NULL;
+    FILE *stream = open_memstream(&bytes, size);
+
+    if(stream == NULL || matrixWriteRaw(a, stream) < 0){
+        printf("Error in checks. Can't copy a matrix. Exiting.\n");
+        exit(0);
+    }
+    fclose(stream);
+
+    return bytes;
+}
+
+char checkSameBits(Matrix *a, Matrix *b){
+    size_t aSize, bSize;
+    char *aBytes = checkRawBytes(a, &aSize), *bBytes = checkRawBytes(b, &bSize);
+    const char ret = aSize == bSize && !memcmp(aBytes, bBytes, aSize);
+
+    free(aBytes);
+    free(bBytes);
+    return ret;
+}
+
+/**
+ * A fixed training set: the class is whether the first two inputs add up to more than one.
+ **/
+void checkData(List *x, List *y){
+    unsigned int seed = 7;
+    double values[CHECK_INPUTS], target[2];
+    int i, k;
+
+    for(i = 0; i < CHECK_SAMPLES; i++){
+        for(k = 0; k < CHECK_INPUTS; k++){
+            values[k] = rand_r(&seed) / (double) RAND_MAX;
+        }
+        target[0] = values[0] + values[1] > 1;
+        target[1] = 1 - target[0];
+
+        Matrix *input = matrixCreate(CHECK_INPUTS, 1, values, CHECK_INPUTS), *output = matrixCreate(2, 1, target, 2);
+        listAppend(x, &input);
+        listAppend(y, &output);
+    }
+}
+
+NeuralNetwork *checkNetwork(){
+    NeuralNetwork *network = neural_network_create(neural_network_solver_adam(.9, .999, .01), 0, NULL, 3);
+
+    neural_network_set_batch_size(network, 16);
+    neural_network_set_max_epochs(network, 3);
+    neural_network_add_input_layer(network, CHECK_INPUTS);
+    neural_network_add_hidden_layer(network, 10, ACTIV_FUNC_RELU);
+    neural_network_add_hidden_layer(network, 6, ACTIV_FUNC_SIGMOID);
+    neural_network_add_output_layer(network, 2);
+
+    return network;
+}
+
+/**
+ * Data-parallel training (4 workers) on a pool of 1 and of 4 threads ends on the very same weights.
+ **/
+char checkDataParallel(List *x, List *y){
+    NeuralNetwork *networks[2];
+    const int pools[2] = {1, 4};
+    int i;
+
+    for(i = 0; i < 2; i++){
+        threadPoolSetSize(pools[i]);
+        networks[i] = checkNetwork();
+        neural_network_set_parallel(networks[i], NEURAL_PARALLEL_DATA, 4);
+        neural_network_train(networks[i], x, y);
+    }
+
+    const char ret = checkSameBits(solver_get_parameters(networks[0]->solver), solver_get_parameters(networks[1]->solver));
+
+    for(i = 0; i < 2; i++){
+        neural_network_destroy(networks[i]);
+    }
+    return ret;
+}
+
+/**
+ * A saved and loaded model predicts the very same outputs as the network it was saved from.
+ **/
+char checkModelFile(List *x, List *y){
+    NeuralNetwork *network = checkNetwork();
+    Matrix *input = matrixCreate(CHECK_INPUTS, CHECK_SAMPLES, NULL, CHECK_INPUTS * CHECK_SAMPLES);
+    char ret = 0;
+    int i, k;
+
+    neural_network_train(network, x, y);
+    for(i = 0; i < CHECK_SAMPLES; i++){
+        Matrix *sample = LIST_DER(Matrix *, listGet(x, i));
+        for(k = 0; k < CHECK_INPUTS; k++){
+            matrixSetValue(input, k, i, matrixGetValue(sample, k, 0));
+        }
+    }
+
+    if(neural_network_save(network, CHECK_MODEL)){
+        NeuralNetwork *loaded = neural_network_load(CHECK_MODEL);
+        Matrix *expected = loaded == NULL ? NULL : matrixConvert(neural_network_predict(network, input), NULL, MATRIX_FLOAT64);
+
+        ret = expected != NULL && checkSameBits(expected, neural_network_predict(loaded, input));
+        matrixDestroy(expected, 0);
+        neural_network_destroy(loaded);
+    }
+
+    remove(CHECK_MODEL);
+    matrixDestroy(input, 0);
+    neural_network_destroy(network);
+    return ret;
+}
+
+/**
+ * One rank's part of the allreduce check: averages a float64 and a float32 matrix holding rank + 1 scaled by position,
+ * returning whether both came back as the average over two ranks.
+ **/
+char checkAllreduceRank(char tcp, int rank){
+    Allreduce *comm = tcp ? allreduceCreateTcp("127.0.0.1", CHECK_PORT, rank, 2) : allreduceCreateShm(CHECK_SHM, rank, 2);
+    Matrix *a[2] = {matrixCreate(3, 50, NULL, 150), matrixCreateF(3, 50, NULL, 150)};
+    char ret = comm != NULL;
+    int i, r, c;
+
+    for(i = 0; i < 2 && ret; i++){
+        for(r = 0; r < 3; r++){
+            for(c = 0; c < 50; c++){
+                matrixSetValue(a[i], r, c, (rank + 1) * (r * 50 + c));
+            }
+        }
+
+        allreduceAverage(comm, a[i]);
+        for(r = 0; r < 3; r++){
+            for(c = 0; c < 50; c++){
+                ret = ret && matrixGetValue(a[i], r, c) == 1.5 * (r * 50 + c);
+            }
+        }
+    }
+
+    allreduceDestroy(comm);
+    matrixDestroy(a[0], 0);
+    matrixDestroy(a[1], 0);
+    return ret;
+}
+
+/**
+ * Two processes (this one as rank 0 and a forked rank 1) averaging over the shared memory or the loopback TCP backend.
+ **/
+char checkAllreduce(char tcp){
+    int status;
+    const pid_t child = fork();
+
+    if(child == 0) _exit(checkAllreduceRank(tcp, 1) ? 0 : 1);
+    if(child < 0) return 0;
+
+    const char ret = checkAllreduceRank(tcp, 0);
+    return waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0 && ret;
+}
+
+int main(){
+    List *x = listCreate(CHECK_SAMPLES, sizeof(Matrix *), NULL, nulled_matrix_destroy);
+    List *y = listCreate(CHECK_SAMPLES, sizeof(Matrix *), NULL, nulled_matrix_destroy);
+    const char *names[4] = {"data parallel across pool sizes", "model file round trip", "shared memory allreduce", "TCP allreduce"};
+    char passed[4];
+    int i, failed = 0;
+
+    checkData(x, y);
+    passed[0] = checkDataParallel(x, y);
+    passed[1] = checkModelFile(x, y);
+    passed[2] = checkAllreduce(0);
+    passed[3] = checkAllreduce(1);
+
+    for(i = 0; i < 4; i++){
+        printf("%s: %s\n", passed[i] ? "PASS" : "FAIL", names[i]);
+        failed += !passed[i];
+    }
+
+    listDestroy(x);
+    listDestroy(y);
+    return failed != 0;
+}
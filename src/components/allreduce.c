@@ -0,0 +1,559 @@
+/**
+ * Allreduce file holding the collectives that let several trainer processes combine their gradients or parameters.
+ *
+ * Two backends implement the same sum:
+ *   - Shared memory, for processes on one host. Every rank copies a chunk of its buffer into its own slot of a POSIX shared
+ *     memory segment, a process-shared barrier is crossed, and every rank adds all the slots up itself.
+ *   - TCP, for processes on several hosts (or one, over loopback). Every rank sends its chunk to rank 0, which adds them up
+ *     and sends the sum back. Ranks raw-copy their elements, so on connecting they check they lay them out the same way.
+ * Either way the ranks are added in rank order, so all of them end up with the very same bits.
+ *
+ * Author: Fabio Hux
+ *
+ * Date Created: October 2026
+ *
+ * Date Last Edited: 10/17/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include "libremodel.h"
+#include "components/matrix.h"
+#include "components/allreduce.h"
+
+/**
+ * Adds count buffers (in order) into dst, elementwise: dst = src[0] + src[1] + ... + src[count - 1].
+ * dst may be src[0].
+ **/
+static void allreduceAdd(void *dst, void **src, int count, long len, char type){
+    long i;
+    int r;
+
+    if(type == MATRIX_FLOAT32){
+        float *out = (float *) dst;
+        if(out != src[0]) memcpy(out, src[0], len * sizeof(float));
+        for(r = 1; r < count; r++){
+            const float *in = (const float *) src[r];
+            for(i = 0; i < len; i++) out[i] += in[i];
+        }
+    }else{
+        double *out = (double *) dst;
+        if(out != src[0]) memcpy(out, src[0], len * sizeof(double));
+        for(r = 1; r < count; r++){
+            const double *in = (const double *) src[r];
+            for(i = 0; i < len; i++) out[i] += in[i];
+        }
+    }
+}
+
+static size_t allreduceElementSize(char type){
+    return type == MATRIX_FLOAT32 ? sizeof(float) : sizeof(double);
+}
+
+/**
+ * Seconds on a clock that only goes forward, to give up on the other ranks ALLREDUCE_TIMEOUT after starting to wait.
+ **/
+static double allreduceClock(){
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+
+/**
+ * Shared memory backend
+ **/
+
+#define ALLREDUCE_SHM_READY 0x52454455  /*Set by rank 0 once the segment is usable*/
+
+typedef struct{
+    atomic_int ready;
+    pid_t creator;  /*Rank 0's process*/
+    int size;
+    pthread_barrier_t barrier;
+} AllreduceShmHeader;
+
+typedef struct{
+    AllreduceShmHeader *header;
+    char *slots;    /*One ALLREDUCE_CHUNK slot per rank, right after the header*/
+    size_t bytes;
+    char *name;
+} AllreduceShm;
+
+//The slots start on a cache line of their own
+#define ALLREDUCE_SHM_HEADER (((sizeof(AllreduceShmHeader) + MATRIX_ALIGN - 1) / MATRIX_ALIGN) * MATRIX_ALIGN)
+
+static void allreduceShmSum(Allreduce *comm, void *data, long len, char type){
+    AllreduceShm *shm = (AllreduceShm *) comm->backend;
+    const size_t eSize = allreduceElementSize(type);
+    const long per = ALLREDUCE_CHUNK / eSize;
+    void *slots[comm->size];
+    long offset;
+    int r;
+
+    for(r = 0; r < comm->size; r++){
+        slots[r] = shm->slots + r * ALLREDUCE_CHUNK;
+    }
+
+    for(offset = 0; offset < len; offset += per){
+        const long count = len - offset < per ? len - offset : per;
+        char *chunk = (char *) data + offset * eSize;
+
+        memcpy(slots[comm->rank], chunk, count * eSize);
+        pthread_barrier_wait(&shm->header->barrier);
+
+        allreduceAdd(chunk, slots, comm->size, count, type);
+
+        //Nobody refills their slot before everyone is done reading it
+        pthread_barrier_wait(&shm->header->barrier);
+    }
+}
+
+static void allreduceShmClose(Allreduce *comm){
+    AllreduceShm *shm = (AllreduceShm *) comm->backend;
+
+    pthread_barrier_wait(&shm->header->barrier);
+    if(comm->rank == 0){
+        atomic_store(&shm->header->ready, 0);
+        pthread_barrier_destroy(&shm->header->barrier);
+        shm_unlink(shm->name);
+    }
+
+    munmap(shm->header, shm->bytes);
+    free(shm->name);
+    free(shm);
+}
+
+/**
+ * Other ranks: maps the segment once rank 0 has set it up. One left behind by a crashed run (its creator is gone) is
+ * passed over until rank 0 replaces it.
+ **/
+static AllreduceShmHeader *allreduceShmJoin(const char *name, int size, size_t bytes){
+    const double deadline = allreduceClock() + ALLREDUCE_TIMEOUT;
+
+    for(;; usleep(1000)){
+        struct stat info;
+
+        if(allreduceClock() > deadline){
+            fprintf(stderr, "Rank 0 didn't set up shared memory segment %s within %d seconds.\n", name, ALLREDUCE_TIMEOUT);
+            return NULL;
+        }
+
+        const int fd = shm_open(name, O_RDWR, 0);
+
+        if(fd < 0 || fstat(fd, &info) || (size_t) info.st_size < ALLREDUCE_SHM_HEADER){
+            if(fd >= 0) close(fd);
+            continue;
+        }
+
+        AllreduceShmHeader *header = (AllreduceShmHeader *) mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(header == MAP_FAILED){
+            fprintf(stderr, "Unable to map shared memory segment %s: %s\n", name, strerror(errno));
+            return NULL;
+        }
+
+        if(atomic_load(&header->ready) == ALLREDUCE_SHM_READY && !(kill(header->creator, 0) && errno == ESRCH)){
+            if(header->size == size && (size_t) info.st_size == bytes) return header;
+
+            fprintf(stderr, "Shared memory segment %s was made for %d ranks, not %d.\n", name, header->size, size);
+            munmap(header, info.st_size);
+            return NULL;
+        }
+
+        munmap(header, info.st_size);
+    }
+}
+
+Allreduce *allreduceCreateShm(const char *name, int rank, int size){
+    if(name == NULL || size < 1 || rank < 0 || rank >= size) return NULL;
+
+    const size_t bytes = ALLREDUCE_SHM_HEADER + (size_t) size * ALLREDUCE_CHUNK;
+    AllreduceShmHeader *header;
+
+    if(rank == 0){
+        //Start from a fresh segment, whatever an earlier run left behind
+        shm_unlink(name);
+        const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if(fd < 0 || ftruncate(fd, bytes)){
+            fprintf(stderr, "Unable to create shared memory segment %s: %s\n", name, strerror(errno));
+            if(fd >= 0) close(fd);
+            return NULL;
+        }
+
+        header = (AllreduceShmHeader *) mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(header == MAP_FAILED){
+            fprintf(stderr, "Unable to map shared memory segment %s: %s\n", name, strerror(errno));
+            shm_unlink(name);
+            return NULL;
+        }
+
+        pthread_barrierattr_t attr;
+
+        pthread_barrierattr_init(&attr);
+        pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_barrier_init(&header->barrier, &attr, size);
+        pthread_barrierattr_destroy(&attr);
+        header->creator = getpid();
+        header->size = size;
+        atomic_store(&header->ready, ALLREDUCE_SHM_READY);
+    }else if((header = allreduceShmJoin(name, size, bytes)) == NULL){
+        return NULL;
+    }
+
+    AllreduceShm *shm = (AllreduceShm *) calloc(1, sizeof(AllreduceShm));
+    Allreduce *comm = (Allreduce *) calloc(1, sizeof(Allreduce));
+    if(shm == NULL || comm == NULL || (shm->name = strdup(name)) == NULL){
+        printf("Error making allreduce. Insufficient space. Exiting.\n");
+        exit(0);
+    }
+
+    shm->header = header;
+    shm->slots = (char *) header + ALLREDUCE_SHM_HEADER;
+    shm->bytes = bytes;
+
+    comm->sum = allreduceShmSum;
+    comm->close = allreduceShmClose;
+    comm->backend = shm;
+    comm->rank = rank;
+    comm->size = size;
+
+    return comm;
+}
+
+
+/**
+ * TCP backend
+ **/
+
+#define ALLREDUCE_TCP_BYTE_ORDER 0x01020304u   /*Reads back differently on a machine of the other endianness*/
+
+typedef struct{
+    int *peers;     /*On rank 0 the socket of every other rank (by rank), elsewhere peers[0] is the socket to rank 0*/
+    char *chunk;    /*Rank 0's receive buffers, one ALLREDUCE_CHUNK per rank*/
+} AllreduceTcp;
+
+//What each side of a connection sends first, so ranks that would read each other's elements wrong never start
+typedef struct{
+    uint32_t byte_order;
+    int32_t rank, size;
+    int32_t float_size, double_size;
+} AllreduceTcpHello;
+
+static void allreduceTcpSend(int socket, const void *data, size_t bytes){
+    const char *next = (const char *) data;
+
+    while(bytes > 0){
+        const ssize_t sent = send(socket, next, bytes, MSG_NOSIGNAL);
+        if(sent <= 0){
+            if(sent < 0 && errno == EINTR) continue;
+            fprintf(stderr, "Allreduce peer lost while sending: %s. Exiting.\n", strerror(errno));
+            exit(0);
+        }
+        next += sent;
+        bytes -= sent;
+    }
+}
+
+static void allreduceTcpReceive(int socket, void *data, size_t bytes){
+    char *next = (char *) data;
+
+    while(bytes > 0){
+        const ssize_t received = recv(socket, next, bytes, 0);
+        if(received <= 0){
+            if(received < 0 && errno == EINTR) continue;
+            fprintf(stderr, "Allreduce peer lost while receiving: %s. Exiting.\n", received ? strerror(errno) : "connection closed");
+            exit(0);
+        }
+        next += received;
+        bytes -= received;
+    }
+}
+
+static void allreduceTcpSum(Allreduce *comm, void *data, long len, char type){
+    AllreduceTcp *tcp = (AllreduceTcp *) comm->backend;
+    const size_t eSize = allreduceElementSize(type);
+    const long per = ALLREDUCE_CHUNK / eSize;
+    long offset;
+    int r;
+
+    for(offset = 0; offset < len; offset += per){
+        const long count = len - offset < per ? len - offset : per;
+        char *chunk = (char *) data + offset * eSize;
+
+        if(comm->rank != 0){
+            allreduceTcpSend(tcp->peers[0], chunk, count * eSize);
+            allreduceTcpReceive(tcp->peers[0], chunk, count * eSize);
+            continue;
+        }
+
+        void *parts[comm->size];
+        parts[0] = chunk;
+        for(r = 1; r < comm->size; r++){
+            parts[r] = tcp->chunk + r * ALLREDUCE_CHUNK;
+            allreduceTcpReceive(tcp->peers[r], parts[r], count * eSize);
+        }
+
+        allreduceAdd(chunk, parts, comm->size, count, type);
+
+        for(r = 1; r < comm->size; r++){
+            allreduceTcpSend(tcp->peers[r], chunk, count * eSize);
+        }
+    }
+}
+
+static void allreduceTcpClose(Allreduce *comm){
+    AllreduceTcp *tcp = (AllreduceTcp *) comm->backend;
+    int r;
+
+    for(r = 0; r < (comm->rank == 0 ? comm->size : 1); r++){
+        if(tcp->peers[r] >= 0) close(tcp->peers[r]);
+    }
+
+    free(tcp->peers);
+    free(tcp->chunk);
+    free(tcp);
+}
+
+static AllreduceTcpHello allreduceTcpHello(int rank, int size){
+    AllreduceTcpHello hello = {.byte_order = ALLREDUCE_TCP_BYTE_ORDER, .rank = rank, .size = size,
+                               .float_size = sizeof(float), .double_size = sizeof(double)};
+    return hello;
+}
+
+/**
+ * Whether hello comes from a rank laying its elements out like this one, in a group of the same size.
+ **/
+static char allreduceTcpHelloMatches(AllreduceTcpHello *hello, int size){
+    if(hello->byte_order != ALLREDUCE_TCP_BYTE_ORDER || hello->float_size != sizeof(float) || hello->double_size != sizeof(double)){
+        fprintf(stderr, "Allreduce peer of rank %d stores its elements differently.\n", hello->rank);
+        return 0;
+    }
+    if(hello->size != size){
+        fprintf(stderr, "Allreduce peer of rank %d is in a group of %d ranks, not %d.\n", hello->rank, hello->size, size);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Rank 0 side: accepts a connection from every other rank. Each one starts by sending its hello, gets rank 0's back and
+ * then a byte telling whether rank 0 takes it.
+ **/
+static char allreduceTcpAccept(AllreduceTcp *tcp, int port, int size){
+    struct sockaddr_in address;
+    struct pollfd waiting;
+    const double deadline = allreduceClock() + ALLREDUCE_TIMEOUT;
+    const AllreduceTcpHello own = allreduceTcpHello(0, size);
+    AllreduceTcpHello hello;
+    const int yes = 1;
+    int listener = socket(AF_INET, SOCK_STREAM, 0), accepted;
+    char taken;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if(listener < 0
+        || setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes))
+        || bind(listener, (struct sockaddr *) &address, sizeof(address))
+        || listen(listener, size)
+    ){
+        fprintf(stderr, "Unable to listen on port %d: %s\n", port, strerror(errno));
+        if(listener >= 0) close(listener);
+        return 0;
+    }
+
+    waiting.fd = listener;
+    waiting.events = POLLIN;
+    for(accepted = 1; accepted < size; accepted++){
+        const double left = deadline - allreduceClock();
+        const int ready = left > 0 ? poll(&waiting, 1, (int) (left * 1000)) : 0;
+        const int peer = ready > 0 ? accept(listener, NULL, NULL) : -1;
+
+        if(peer < 0){
+            if(ready != 0 && errno == EINTR){
+                accepted--;
+                continue;
+            }
+            if(ready == 0){
+                fprintf(stderr, "Only %d of %d allreduce ranks connected within %d seconds.\n", accepted, size, ALLREDUCE_TIMEOUT);
+            }else{
+                fprintf(stderr, "Unable to accept allreduce peer: %s\n", strerror(errno));
+            }
+            close(listener);
+            return 0;
+        }
+
+        allreduceTcpReceive(peer, &hello, sizeof(hello));
+        allreduceTcpSend(peer, &own, sizeof(own));
+        if(!allreduceTcpHelloMatches(&hello, size)){
+            taken = 0;
+            allreduceTcpSend(peer, &taken, 1);
+            close(peer);
+            close(listener);
+            return 0;
+        }
+
+        taken = hello.rank >= 1 && hello.rank < size && tcp->peers[hello.rank] < 0;
+        allreduceTcpSend(peer, &taken, 1);
+        if(!taken){
+            fprintf(stderr, "Allreduce peer sent bad rank %d. Ignoring it.\n", hello.rank);
+            close(peer);
+            accepted--;
+            continue;
+        }
+        setsockopt(peer, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        tcp->peers[hello.rank] = peer;
+    }
+
+    close(listener);
+    return 1;
+}
+
+/**
+ * Other ranks: connects to rank 0 (retrying until it listens) and trades hellos with it.
+ **/
+static char allreduceTcpConnect(AllreduceTcp *tcp, const char *host, int port, int rank, int size){
+    struct addrinfo hints, *found = NULL;
+    const double deadline = allreduceClock() + ALLREDUCE_TIMEOUT;
+    const AllreduceTcpHello own = allreduceTcpHello(rank, size);
+    AllreduceTcpHello hello;
+    char service[16], taken;
+    const int yes = 1;
+    int peer = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%d", port);
+
+    if(getaddrinfo(host, service, &hints, &found) || found == NULL){
+        fprintf(stderr, "Unable to resolve allreduce host %s.\n", host);
+        return 0;
+    }
+
+    for(;;){
+        peer = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+        if(peer < 0){
+            fprintf(stderr, "Unable to open socket: %s\n", strerror(errno));
+            freeaddrinfo(found);
+            return 0;
+        }
+        if(!connect(peer, found->ai_addr, found->ai_addrlen)) break;
+
+        close(peer);
+        if(allreduceClock() > deadline){
+            fprintf(stderr, "Allreduce rank 0 wasn't listening at %s:%d within %d seconds.\n", host, port, ALLREDUCE_TIMEOUT);
+            freeaddrinfo(found);
+            return 0;
+        }
+        usleep(10000);
+    }
+    freeaddrinfo(found);
+
+    setsockopt(peer, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    allreduceTcpSend(peer, &own, sizeof(own));
+    allreduceTcpReceive(peer, &hello, sizeof(hello));
+    taken = allreduceTcpHelloMatches(&hello, size);
+    if(taken) allreduceTcpReceive(peer, &taken, 1);
+    if(!taken){
+        fprintf(stderr, "Allreduce rank 0 turned rank %d down.\n", rank);
+        close(peer);
+        return 0;
+    }
+
+    tcp->peers[0] = peer;
+    return 1;
+}
+
+Allreduce *allreduceCreateTcp(const char *host, int port, int rank, int size){
+    if(size < 1 || rank < 0 || rank >= size || port < 1 || port > 65535 || (rank != 0 && host == NULL)) return NULL;
+
+    AllreduceTcp *tcp = (AllreduceTcp *) calloc(1, sizeof(AllreduceTcp));
+    Allreduce *comm = (Allreduce *) calloc(1, sizeof(Allreduce));
+    if(tcp == NULL || comm == NULL || (tcp->peers = (int *) malloc(size * sizeof(int))) == NULL){
+        printf("Error making allreduce. Insufficient space. Exiting.\n");
+        exit(0);
+    }
+    memset(tcp->peers, -1, size * sizeof(int));
+
+    if(rank == 0 && size > 1 && (tcp->chunk = (char *) malloc((size_t) size * ALLREDUCE_CHUNK)) == NULL){
+        printf("Error making allreduce. Insufficient space. Exiting.\n");
+        exit(0);
+    }
+
+    comm->sum = allreduceTcpSum;
+    comm->close = allreduceTcpClose;
+    comm->backend = tcp;
+    comm->rank = rank;
+    comm->size = size;
+
+    if(size > 1 && !(rank == 0 ? allreduceTcpAccept(tcp, port, size) : allreduceTcpConnect(tcp, host, port, rank, size))){
+        allreduceTcpClose(comm);
+        free(comm);
+        return NULL;
+    }
+
+    return comm;
+}
+
+
+/**
+ * Backend independent functions
+ **/
+
+void allreduceDestroy(Allreduce *comm){
+    if(comm == NULL) return;
+
+    comm->close(comm);
+    free(comm);
+}
+
+void allreduceAverage(Allreduce *comm, Matrix *a){
+    if(comm == NULL || a == NULL || comm->size == 1) return;
+
+    void *data = a->type == MATRIX_FLOAT32 ? (void *) a->fmat : (void *) a->mat;
+    const size_t eSize = allreduceElementSize(a->type);
+    long i;
+
+    //Owned storage is summed in one go, padding included (it's zero everywhere). A view's gaps belong to someone else.
+    if(a->owner || a->n == 1 || a->ld == a->m){
+        comm->sum(comm, data, (long) (a->n - 1) * a->ld + a->m, a->type);
+    }else{
+        for(i = 0; i < a->n; i++){
+            comm->sum(comm, (char *) data + i * a->ld * eSize, a->m, a->type);
+        }
+    }
+
+    matrixConstantMul(a, 1.0 / comm->size);
+}
+
+int allreduceGetRank(Allreduce *comm){
+    if(comm == NULL) return -1;
+    return comm->rank;
+}
+
+int allreduceGetSize(Allreduce *comm){
+    if(comm == NULL) return -1;
+    return comm->size;
+}
@@ -0,0 +1,204 @@
+/**
+ * GEMM file holding the cache-blocked, packed matrix multiplication engine used behind matrixMul.
+ *
+ * The layout follows the usual Goto/BLIS scheme: B is packed into GEMM_KC x GEMM_NC panels of GEMM_NR wide slivers,
+ * A is packed into GEMM_MC x GEMM_KC panels of GEMM_MR tall slivers, and a register-blocked micro-kernel computes
+ * one GEMM_MR x GEMM_NR tile of C at a time. Matrix-vector and rank-1 products skip the packing since every element is only used once.
+ *
+ * The engine itself lives in gemm_template.h and is instantiated here once for float64 and once for float32.
+ * Packing also converts, so operands of the other element type cost nothing extra on the packed path.
+ *
+ * Author: Fabio Hux
+ *
+ * Date Created: October 2026
+ *
+ * Date Last Edited: 10/17/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "libremodel.h"
+#include "components/gemm.h"
+#include "components/simd.h"
+
+//Frees a thread's packing buffers when it exits (only registered once the thread has some)
+static pthread_key_t gemm_buffers_key;
+static pthread_once_t gemm_buffers_once = PTHREAD_ONCE_INIT;
+static void gemmBuffersRelease(void *unused);
+
+static void gemmBuffersKeyCreate(void){
+    pthread_key_create(&gemm_buffers_key, gemmBuffersRelease);
+}
+
+static void *gemmReserve(void **buffer, long *len, long needed, size_t eSize){
+    if(needed > *len){
+        free(*buffer);
+        if(posix_memalign(buffer, 64, needed * eSize)){
+            printf("Error making GEMM packing buffer. Insufficient space. Exiting.\n");
+            exit(0);
+        }
+        *len = needed;
+
+        pthread_once(&gemm_buffers_once, gemmBuffersKeyCreate);
+        pthread_setspecific(gemm_buffers_key, *buffer);
+    }
+    return *buffer;
+}
+
+GemmOperand gemmOperandOffset(GemmOperand op, long row, long col){
+    const long offset = row * op.rowStep + col * op.colStep;
+
+    if(op.type == MATRIX_FLOAT32){
+        op.data = (float *) op.data + offset;
+    }else{
+        op.data = (double *) op.data + offset;
+    }
+    return op;
+}
+
+GemmEpilogue gemmEpilogueOffset(GemmEpilogue epi, long row, long col){
+    if(epi.bias.data != NULL) epi.bias = gemmOperandOffset(epi.bias, row, col);
+    if(epi.out.data != NULL) epi.out = gemmOperandOffset(epi.out, row, col);
+    return epi;
+}
+
+static inline double gemmEpilogueBias(const GemmEpilogue *epi, long offset){
+    return epi->bias.type == MATRIX_FLOAT32 ? ((const float *) epi->bias.data)[offset] : ((const double *) epi->bias.data)[offset];
+}
+
+static inline void gemmEpilogueStore(const GemmEpilogue *epi, long offset, double value){
+    if(epi->out.type == MATRIX_FLOAT32){
+        ((float *) epi->out.data)[offset] = (float) value;
+    }else{
+        ((double *) epi->out.data)[offset] = value;
+    }
+}
+
+/**
+ * Copies one sliver of LEN (out of WIDTH) lines from a SRC_T source into dst, converting to GEMM_T and zero filling the rest.
+ * STEP walks across the sliver and DEPTH_STEP walks along kc.
+ **/
+#define GEMM_PACK_SLIVER(SRC_T, DATA, OFFSET, LEN, WIDTH, STEP, DEPTH_STEP) \
+    { \
+        const SRC_T *src = (const SRC_T *) (DATA) + (OFFSET); \
+        int q; \
+        for(p = 0; p < kc; p++, dst += (WIDTH)){ \
+            for(q = 0; q < (LEN); q++){ \
+                dst[q] = (GEMM_T) src[q * (STEP) + p * (DEPTH_STEP)]; \
+            } \
+            for(; q < (WIDTH); q++){ \
+                dst[q] = 0; \
+            } \
+        } \
+    }
+
+/**
+ * Body of the register-blocked micro-kernel.
+ *
+ * Computes the GEMM_MR x NR tile acc = a * b over kc packed columns/rows. The fixed trip counts let the compiler
+ * keep acc in vector registers and vectorize the NR loop. It is compiled once per instruction set and the widest
+ * one the host supports is picked at startup, the same way as the kernels in simd.c.
+ **/
+#define GEMM_MICRO_KERNEL_BODY(T, NR) \
+    T tile[GEMM_MR][NR] = {{0}}; \
+    int i, j, p; \
+    for(p = 0; p < kc; p++, a += GEMM_MR, b += (NR)){ \
+        for(i = 0; i < GEMM_MR; i++){ \
+            for(j = 0; j < (NR); j++){ \
+                tile[i][j] += a[i] * b[j]; \
+            } \
+        } \
+    } \
+    memcpy(acc, tile, sizeof(tile));
+
+
+//float64 instantiation
+#define GEMM_T double
+#define GEMM_TYPE_ID MATRIX_FLOAT64
+#define GEMM_TNR GEMM_NR
+#define GEMM_FN(x) x##D
+#define GEMM_DOT simd.dot
+#define GEMM_AXPY simd.axpy
+#define GEMM_EXP exp
+#include "components/gemm_template.h"
+#undef GEMM_T
+#undef GEMM_TYPE_ID
+#undef GEMM_TNR
+#undef GEMM_FN
+#undef GEMM_DOT
+#undef GEMM_AXPY
+#undef GEMM_EXP
+
+//float32 instantiation
+#define GEMM_T float
+#define GEMM_TYPE_ID MATRIX_FLOAT32
+#define GEMM_TNR GEMM_NR_F
+#define GEMM_FN(x) x##F
+#define GEMM_DOT simd.dotF
+#define GEMM_AXPY simd.axpyF
+#define GEMM_EXP expf
+#include "components/gemm_template.h"
+#undef GEMM_T
+#undef GEMM_TYPE_ID
+#undef GEMM_TNR
+#undef GEMM_FN
+#undef GEMM_DOT
+#undef GEMM_AXPY
+#undef GEMM_EXP
+
+static void gemmBuffersRelease(void *unused){
+    (void) unused;
+
+    free(gemm_pack_aD);
+    free(gemm_pack_bD);
+    free(gemm_pack_aF);
+    free(gemm_pack_bF);
+    gemm_pack_aD = gemm_pack_bD = NULL;
+    gemm_pack_aF = gemm_pack_bF = NULL;
+    gemm_pack_a_lenD = gemm_pack_b_lenD = gemm_pack_a_lenF = gemm_pack_b_lenF = 0;
+}
+
+__attribute__((constructor))
+static void gemmInit(void){
+    const int level = simdDetectLevel();
+
+    gemmSelectKernelD(level);
+    gemmSelectKernelF(level);
+}
+
+void gemm(int m, int n, int k, double alpha, GemmOperand a, GemmOperand b, double beta, GemmOperand c){
+    gemmFused(m, n, k, alpha, a, b, beta, c, NULL);
+}
+
+void gemmFused(int m, int n, int k, double alpha, GemmOperand a, GemmOperand b, double beta, GemmOperand c, const GemmEpilogue *epi){
+    if(m <= 0 || n <= 0) return;
+
+    /**
+     * The kernels prefer C with contiguous rows and a vector operand on the right.
+     * Since C^T = B^T * A^T, we can swap the operands and strides to get there without copying anything.
+     **/
+    if(n > 1 && (m == 1 || (c.colStep != 1 && c.rowStep == 1))){
+        GemmOperand at = {a.data, a.colStep, a.rowStep, a.type};
+        GemmOperand bt = {b.data, b.colStep, b.rowStep, b.type};
+        GemmOperand ct = {c.data, c.colStep, c.rowStep, c.type};
+        GemmEpilogue et;
+
+        if(epi != NULL){
+            et = *epi;
+            et.bias.rowStep = epi->bias.colStep;
+            et.bias.colStep = epi->bias.rowStep;
+            et.out.rowStep = epi->out.colStep;
+            et.out.colStep = epi->out.rowStep;
+        }
+        gemmFused(n, m, k, alpha, bt, at, beta, ct, epi == NULL ? NULL : &et);
+        return;
+    }
+
+    if(c.type == MATRIX_FLOAT32){
+        gemmComputeF(m, n, k, (float) alpha, a, b, (float) beta, c, epi);
+    }else{
+        gemmComputeD(m, n, k, alpha, a, b, beta, c, epi);
+    }
+}
@@ -5,26 +5,533 @@
  * 
  * Date Created: August 2020
  * 
- * Date Last Edited: 12/19/2020
+ * Date Last Edited: 10/17/2026
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include "libremodel.h"
 #include "components/matrix.h"
+#include "components/gemm.h"
+#include "components/simd.h"
+#include "components/thread_pool.h"
 
 
-//Private helper functions
-void addOp(double *target, double value){
-    *target += value;
+//Private helper functions for element access regardless of the element type
+static inline double matrixLoad(Matrix *a, long index){
+    return a->type == MATRIX_FLOAT32 ? a->fmat[index] : a->mat[index];
 }
 
-void subOp(double *target, double value){
-    *target -= value;
+static inline void matrixStore(Matrix *a, long index, double value){
+    if(a->type == MATRIX_FLOAT32){
+        a->fmat[index] = (float) value;
+    }else{
+        a->mat[index] = value;
+    }
+}
+
+//Elements per MATRIX_ALIGN bytes
+static inline int matrixLanes(char type){
+    return MATRIX_ALIGN / (type == MATRIX_FLOAT32 ? sizeof(float) : sizeof(double));
+}
+
+//Storage offset of the index-th element in row-major order (rows are ld apart)
+static inline long matrixOffset(Matrix *a, long index){
+    return a->ld == a->m ? index : (index / a->m) * a->ld + index % a->m;
+}
+
+static inline void *matrixRow(Matrix *a, long row){
+    return a->type == MATRIX_FLOAT32 ? (void *) (a->fmat + row * a->ld) : (void *) (a->mat + row * a->ld);
+}
+
+static GemmOperand matrixOperand(Matrix *a, char transposed){
+    GemmOperand op = {matrixRow(a, 0), a->ld, 1, a->type};
+
+    if(transposed){
+        op.rowStep = 1;
+        op.colStep = a->ld;
+    }
+    return op;
+}
+
+//Private helper structs/functions for splitting work across the thread pool
+typedef struct{
+    GemmOperand a, b, c;
+    int rows, cols, inner;
+    double alpha, beta;
+    int colBlock;   /*Columns per part when splitting columns, a whole cache line of c so threads never share one*/
+    char splitCols;
+    GemmEpilogue epi;
+    char fused;     /*Whether epi is applied*/
+} MatrixMulTask;
+
+static void matrixMulPart(void *arg, int start, int end){
+    MatrixMulTask *t = (MatrixMulTask *) arg;
+
+    if(t->splitCols){
+        start *= t->colBlock;
+        end = end * t->colBlock < t->cols ? end * t->colBlock : t->cols;
+        const GemmEpilogue epi = gemmEpilogueOffset(t->epi, 0, start);
+        gemmFused(t->rows, end - start, t->inner, t->alpha, t->a, gemmOperandOffset(t->b, 0, start), t->beta, gemmOperandOffset(t->c, 0, start), t->fused ? &epi : NULL);
+    }else{
+        const GemmEpilogue epi = gemmEpilogueOffset(t->epi, start, 0);
+        gemmFused(end - start, t->cols, t->inner, t->alpha, gemmOperandOffset(t->a, start, 0), t->b, t->beta, gemmOperandOffset(t->c, start, 0), t->fused ? &epi : NULL);
+    }
+}
+
+/**
+ * Runs the product described by task, split across the pool when it is big enough.
+ **/
+static void matrixMulRun(MatrixMulTask *task, char cTransposed){
+    if(threadPoolWorthIt((double) task->rows * task->cols * task->inner)){
+        task->splitCols = task->rows < task->cols && task->rows < threadPoolGetSize();
+        if(task->splitCols && !cTransposed) task->colBlock = matrixLanes(task->c.type);
+        threadPoolRun(matrixMulPart, task, task->splitCols ? (task->cols + task->colBlock - 1) / task->colBlock : task->rows);
+    }else{
+        matrixMulPart(task, 0, task->rows);
+    }
+}
+
+typedef struct{
+    Matrix *a, *b, *c;
+    long aRowStep, aColStep, bRowStep, bColStep, cRowStep, cColStep;
+    int rows, cols;
+    int rowBlock;   /*Rows per part, enough to fill a cache line of c when its rows are narrow*/
+    char sub;
+} MatrixAddTask;
+
+/**
+ * Contiguous rows of one element type, so the compiler can vectorize.
+ **/
+#define MATRIX_ADD_ROW(T, A, B, C) \
+    { \
+        const T *aRow = (A) + i * t->aRowStep, *bRow = (B) + i * t->bRowStep; \
+        T *cRow = (C) + i * t->cRowStep; \
+        if(t->sub){ \
+            for(j = 0; j < cols; j++) cRow[j] = aRow[j] - bRow[j]; \
+        }else{ \
+            for(j = 0; j < cols; j++) cRow[j] = aRow[j] + bRow[j]; \
+        } \
+    }
+
+static void matrixAddPart(void *arg, int start, int end){
+    MatrixAddTask *t = (MatrixAddTask *) arg;
+    const int cols = t->cols;
+
+    start *= t->rowBlock;
+    end = end * t->rowBlock < t->rows ? end * t->rowBlock : t->rows;
+    const char contiguous = t->aColStep == 1 && t->bColStep == 1 && t->cColStep == 1;
+    const char type = t->c->type;
+    const char sameType = t->a->type == type && t->b->type == type;
+    int i, j;
+
+    for(i = start; i < end; i++){
+        if(contiguous && sameType && type == MATRIX_FLOAT32){
+            MATRIX_ADD_ROW(float, t->a->fmat, t->b->fmat, t->c->fmat)
+        }else if(contiguous && sameType){
+            MATRIX_ADD_ROW(double, t->a->mat, t->b->mat, t->c->mat)
+        }else{
+            //Strided or mixed element types
+            for(j = 0; j < cols; j++){
+                const double aVal = matrixLoad(t->a, i * t->aRowStep + j * t->aColStep);
+                const double bVal = matrixLoad(t->b, i * t->bRowStep + j * t->bColStep);
+                matrixStore(t->c, i * t->cRowStep + j * t->cColStep, t->sub ? aVal - bVal : aVal + bVal);
+            }
+        }
+    }
+}
+
+/**
+ * Runs c = a (+/-) b over the logical n x m shape, where each operand is described by its row/column steps.
+ **/
+static void matrixAddRun(Matrix *a, Matrix *b, Matrix *c, char flags, int n, int m, char sub){
+    MatrixAddTask task = {a, b, c, a->ld, 1, b->ld, 1, c->ld, 1, n, m, 1, sub};
+
+    if(flags & MATRIX_A_TRANS){
+        task.aRowStep = 1;
+        task.aColStep = a->ld;
+    }
+    if(flags & MATRIX_B_TRANS){
+        task.bRowStep = 1;
+        task.bColStep = b->ld;
+    }
+    if(flags & MATRIX_C_TRANS){
+        task.cRowStep = 1;
+        task.cColStep = c->ld;
+    }else if(c->ld < matrixLanes(c->type)){
+        task.rowBlock = matrixLanes(c->type) / c->ld;
+    }
+
+    if(threadPoolWorthIt((double) n * m)){
+        threadPoolRun(matrixAddPart, &task, (n + task.rowBlock - 1) / task.rowBlock);
+    }else{
+        task.rowBlock = 1;
+        matrixAddPart(&task, 0, n);
+    }
+}
+
+/**
+ * Elementwise kernels over one contiguous run of len elements.
+ *
+ * The switch sits outside the loops, so each case is a plain counted loop the compiler can vectorize.
+ **/
+#define MATRIX_ELEMENT_KERNELS(SUFFIX, T, EXP, SQRT) \
+    static void matrixMapRun##SUFFIX(const T *a, T *c, long len, int op){ \
+        long i; \
+        switch(op){ \
+            case MATRIX_MAP_COPY: \
+                if(a != c) memmove(c, a, len * sizeof(T)); \
+                break; \
+            case MATRIX_MAP_SIGMOID: \
+                for(i = 0; i < len; i++) c[i] = 1 / (1 + EXP(-a[i])); \
+                break; \
+            case MATRIX_MAP_RELU: \
+                for(i = 0; i < len; i++) c[i] = a[i] < 0 ? 0 : a[i]; \
+                break; \
+            case MATRIX_MAP_DER_SIGMOID: \
+                for(i = 0; i < len; i++) c[i] = a[i] * (1 - a[i]); \
+                break; \
+            case MATRIX_MAP_DER_RELU: \
+                for(i = 0; i < len; i++) c[i] = a[i] < 0 ? 0 : 1; \
+                break; \
+            case MATRIX_MAP_EXP: \
+                for(i = 0; i < len; i++) c[i] = EXP(a[i]); \
+                break; \
+            case MATRIX_MAP_SQUARE: \
+                for(i = 0; i < len; i++) c[i] = a[i] * a[i]; \
+                break; \
+            case MATRIX_MAP_SQRT: \
+                for(i = 0; i < len; i++) c[i] = SQRT(a[i]); \
+                break; \
+        } \
+    } \
+    static void matrixZipRun##SUFFIX(const T *a, const T *b, T *c, long len, int op){ \
+        long i; \
+        switch(op){ \
+            case MATRIX_ZIP_ADD: \
+                for(i = 0; i < len; i++) c[i] = a[i] + b[i]; \
+                break; \
+            case MATRIX_ZIP_SUB: \
+                for(i = 0; i < len; i++) c[i] = a[i] - b[i]; \
+                break; \
+            case MATRIX_ZIP_MUL: \
+                for(i = 0; i < len; i++) c[i] = a[i] * b[i]; \
+                break; \
+            case MATRIX_ZIP_DIV: \
+                for(i = 0; i < len; i++) c[i] = a[i] / b[i]; \
+                break; \
+            case MATRIX_ZIP_DER_SIGMOID: \
+                for(i = 0; i < len; i++) c[i] = a[i] * b[i] * (1 - b[i]); \
+                break; \
+            case MATRIX_ZIP_DER_RELU: \
+                for(i = 0; i < len; i++) c[i] = b[i] < 0 ? 0 : a[i]; \
+                break; \
+        } \
+    }
+
+MATRIX_ELEMENT_KERNELS(D, double, exp, sqrt)
+MATRIX_ELEMENT_KERNELS(F, float, expf, sqrtf)
+
+//Single element versions of the kernels above, for operands of mixed element types
+static double matrixMapScalar(double a, int op){
+    double c = a;
+    matrixMapRunD(&a, &c, 1, op);
+    return c;
+}
+
+static double matrixZipScalar(double a, double b, int op){
+    double c = 0;
+    matrixZipRunD(&a, &b, &c, 1, op);
+    return c;
+}
+
+typedef struct{
+    Matrix *a, *b, *c;  /*b is NULL for a map*/
+    long len;           /*Elements per row, or all of them when every operand is contiguous*/
+    int rows;
+    int block;          /*Elements per part when contiguous, a whole cache line so threads never share one*/
+    int op;
+} MatrixElementTask;
+
+static void matrixElementPart(void *arg, int start, int end){
+    MatrixElementTask *t = (MatrixElementTask *) arg;
+    Matrix *a = t->a, *b = t->b, *c = t->c;
+    const char type = c->type;
+    const char sameType = a->type == type && (b == NULL || b->type == type);
+    long from = 0, len = t->len, i;
+    int row;
+
+    if(t->rows == 1){
+        //One contiguous run, split into blocks
+        from = (long) start * t->block;
+        len = (long) end * t->block < t->len ? (long) end * t->block - from : t->len - from;
+        start = 0;
+        end = 1;
+    }
+
+    for(row = start; row < end; row++){
+        const long aOff = (long) row * a->ld + from, cOff = (long) row * c->ld + from;
+        const long bOff = b == NULL ? 0 : (long) row * b->ld + from;
+
+        if(sameType && type == MATRIX_FLOAT32){
+            if(b == NULL) matrixMapRunF(a->fmat + aOff, c->fmat + cOff, len, t->op);
+            else matrixZipRunF(a->fmat + aOff, b->fmat + bOff, c->fmat + cOff, len, t->op);
+        }else if(sameType){
+            if(b == NULL) matrixMapRunD(a->mat + aOff, c->mat + cOff, len, t->op);
+            else matrixZipRunD(a->mat + aOff, b->mat + bOff, c->mat + cOff, len, t->op);
+        }else{
+            for(i = 0; i < len; i++){
+                const double value = b == NULL ? matrixMapScalar(matrixLoad(a, aOff + i), t->op)
+                                               : matrixZipScalar(matrixLoad(a, aOff + i), matrixLoad(b, bOff + i), t->op);
+                matrixStore(c, cOff + i, value);
+            }
+        }
+    }
+}
+
+/**
+ * Runs a map (b == NULL) or zip over equally shaped a, b and c, split across the pool when it is big enough.
+ **/
+static void matrixElementRun(Matrix *a, Matrix *b, Matrix *c, int op){
+    const char contiguous = a->ld == a->m && c->ld == c->m && (b == NULL || b->ld == b->m);
+    MatrixElementTask task = {a, b, c, c->m, c->n, 1, op};
+
+    if(contiguous){
+        task.len = (long) c->n * c->m;
+        task.rows = 1;
+        task.block = matrixLanes(c->type);
+    }
+
+    const int parts = task.rows == 1 ? (int) ((task.len + task.block - 1) / task.block) : task.rows;
+
+    if(threadPoolWorthIt((double) c->n * c->m)){
+        threadPoolRun(matrixElementPart, &task, parts);
+    }else{
+        matrixElementPart(&task, 0, parts);
+    }
+}
+
+/**
+ * Fused optimizer updates over one contiguous run of len elements: the moments and w are each read and written once.
+ * g is the (descent) gradient, so every update adds to w. p holds the op's scalars as documented in libremodel.h.
+ * STORE(i) runs once w[i] is final, which is where the mixed precision kernel writes its float shadow s.
+ **/
+#define MATRIX_UPDATE_KERNELS(SUFFIX, T, G, SQRT, STORE) \
+    static void matrixUpdateRun##SUFFIX(T *restrict w, T *restrict m, T *restrict v, const G *restrict g, float *restrict s, long len, int op, const double *p){ \
+        long i; \
+        (void) s; \
+        switch(op){ \
+            case MATRIX_UPDATE_SGD:{ \
+                const T rate = (T) p[0]; \
+                for(i = 0; i < len; i++){ \
+                    w[i] += rate * g[i]; \
+                    STORE(i); \
+                } \
+                break; \
+            } \
+            case MATRIX_UPDATE_MOMENTUM:{ \
+                const T momentum = (T) p[0], rate = (T) p[1]; \
+                for(i = 0; i < len; i++){ \
+                    m[i] = momentum * m[i] + g[i]; \
+                    w[i] += rate * m[i]; \
+                    STORE(i); \
+                } \
+                break; \
+            } \
+            case MATRIX_UPDATE_RMSPROP:{ \
+                const T decay = (T) p[0], rate = (T) p[1], eps = (T) p[2]; \
+                for(i = 0; i < len; i++){ \
+                    const T grad = g[i]; \
+                    v[i] = decay * v[i] + (1 - decay) * grad * grad; \
+                    w[i] += rate * grad / (SQRT(v[i]) + eps); \
+                    STORE(i); \
+                } \
+                break; \
+            } \
+            case MATRIX_UPDATE_ADAM:{ \
+                const T beta1 = (T) p[0], beta2 = (T) p[1], rate = (T) p[2], eps = (T) p[3]; \
+                for(i = 0; i < len; i++){ \
+                    const T grad = g[i]; \
+                    m[i] = beta1 * m[i] + (1 - beta1) * grad; \
+                    v[i] = beta2 * v[i] + (1 - beta2) * grad * grad; \
+                    w[i] += rate * m[i] / (SQRT(v[i]) + eps); \
+                    STORE(i); \
+                } \
+                break; \
+            } \
+        } \
+    }
+
+#define MATRIX_UPDATE_NO_STORE(I)
+#define MATRIX_UPDATE_SHADOW(I) (s[I] = (float) w[I])
+
+MATRIX_UPDATE_KERNELS(D, double, double, sqrt, MATRIX_UPDATE_NO_STORE)
+MATRIX_UPDATE_KERNELS(F, float, float, sqrtf, MATRIX_UPDATE_NO_STORE)
+MATRIX_UPDATE_KERNELS(M, double, float, sqrt, MATRIX_UPDATE_SHADOW)
+
+typedef struct{
+    Matrix *w, *m, *v, *g;  /*m or v is NULL when the op doesn't use it*/
+    Matrix *s;  /*float32 shadow of a float64 w (NULL if none)*/
+    long len;
+    int rows, block;
+    int op;
+    double p[4];
+} MatrixUpdateTask;
+
+//Row (or contiguous run) of a possibly absent operand
+#define MATRIX_UPDATE_ROW(FIELD, X, OFF) ((X) == NULL ? NULL : (X)->FIELD + (long) row * (X)->ld + (OFF))
+
+static void matrixUpdatePart(void *arg, int start, int end){
+    MatrixUpdateTask *t = (MatrixUpdateTask *) arg;
+    long from = 0, len = t->len;
+    int row;
+
+    if(t->rows == 1){
+        from = (long) start * t->block;
+        len = (long) end * t->block < t->len ? (long) end * t->block - from : t->len - from;
+        start = 0;
+        end = 1;
+    }
+
+    for(row = start; row < end; row++){
+        if(t->s != NULL){
+            matrixUpdateRunM(MATRIX_UPDATE_ROW(mat, t->w, from), MATRIX_UPDATE_ROW(mat, t->m, from), MATRIX_UPDATE_ROW(mat, t->v, from),
+                             MATRIX_UPDATE_ROW(fmat, t->g, from), MATRIX_UPDATE_ROW(fmat, t->s, from), len, t->op, t->p);
+        }else if(t->w->type == MATRIX_FLOAT32){
+            matrixUpdateRunF(MATRIX_UPDATE_ROW(fmat, t->w, from), MATRIX_UPDATE_ROW(fmat, t->m, from),
+                             MATRIX_UPDATE_ROW(fmat, t->v, from), MATRIX_UPDATE_ROW(fmat, t->g, from), NULL, len, t->op, t->p);
+        }else{
+            matrixUpdateRunD(MATRIX_UPDATE_ROW(mat, t->w, from), MATRIX_UPDATE_ROW(mat, t->m, from),
+                             MATRIX_UPDATE_ROW(mat, t->v, from), MATRIX_UPDATE_ROW(mat, t->g, from), NULL, len, t->op, t->p);
+        }
+    }
+}
+
+/**
+ * Checks that every given operand matches w in shape and element type, then runs the update across the pool if it is big enough.
+ * With a shadow, w and the moments are float64 while g and the shadow are float32.
+ **/
+static void matrixUpdateRun(MatrixUpdateTask *task){
+    Matrix *operands[4] = {task->m, task->v, task->g, task->s};
+    Matrix *w = task->w;
+    const char low = task->s != NULL ? MATRIX_FLOAT32 : w->type;
+    char contiguous = w->ld == w->m;
+    int i;
+
+    if(task->s != NULL && w->type != MATRIX_FLOAT64){
+        fprintf(stderr, "Error in matrix update. A float32 shadow needs float64 weights.\n");
+        return;
+    }
+
+    for(i = 0; i < 4; i++){
+        if(operands[i] == NULL) continue;
+        if(operands[i]->n != w->n || operands[i]->m != w->m || operands[i]->type != (i < 2 ? w->type : low)){
+            fprintf(stderr, "Error in matrix update. Operand [%d,%d] doesn't match [%d,%d] of the same type.\n", operands[i]->n, operands[i]->m, w->n, w->m);
+            return;
+        }
+        contiguous = contiguous && operands[i]->ld == operands[i]->m;
+    }
+
+    task->len = w->m;
+    task->rows = w->n;
+    task->block = 1;
+    if(contiguous){
+        task->len = (long) w->n * w->m;
+        task->rows = 1;
+        task->block = matrixLanes(w->type);
+    }
+
+    const int parts = task->rows == 1 ? (int) ((task->len + task->block - 1) / task->block) : task->rows;
+
+    if(threadPoolWorthIt((double) w->n * w->m)){
+        threadPoolRun(matrixUpdatePart, task, parts);
+    }else{
+        matrixUpdatePart(task, 0, parts);
+    }
 }
 
-void setOp(double *target, double value){
-    *target = value;
+/**
+ * Row stride of a freshly allocated n x m matrix: rows are padded to whole vectors once they're at least one vector wide.
+ **/
+static inline int matrixLd(int m, char type){
+    const int lanes = matrixLanes(type);
+    return m < lanes ? m : ((m + lanes - 1) / lanes) * lanes;
+}
+
+/**
+ * Allocates an n x m Matrix of the given element type, zero filled.
+ *
+ * The storage is MATRIX_ALIGN aligned and rows at least a vector wide are padded to a multiple of it,
+ * so every such row starts on its own cache line. Narrower rows (column vectors) stay packed.
+ **/
+static Matrix *matrixAllocate(int n, int m, char type){
+    Matrix *matrix = calloc(1, sizeof(Matrix));
+ 
+    if(matrix == NULL){
+        printf("Error making matrix. Insufficient space. Exiting.\n");
+        exit(0);
+    }
+
+    const int ld = matrixLd(m, type);
+    const size_t eSize = type == MATRIX_FLOAT32 ? sizeof(float) : sizeof(double);
+    const size_t bytes = (((size_t) n * ld * eSize + MATRIX_ALIGN - 1) / MATRIX_ALIGN) * MATRIX_ALIGN;
+    void *storage = NULL;
+
+    if(posix_memalign(&storage, MATRIX_ALIGN, bytes)){
+        printf("Error making matrix list. Insufficient space. Exiting.\n");
+        exit(0);
+    }
+    memset(storage, 0, bytes);
+
+    if(type == MATRIX_FLOAT32){
+        matrix->fmat = (float *) storage;
+    }else{
+        matrix->mat = (double *) storage;
+    }
+
+    matrix->n = n;
+    matrix->m = m;
+    matrix->ld = ld;
+    matrix->type = type;
+    matrix->owner = 1;
+    return matrix;
+}
+
+/**
+ * Points view at the n x m block whose first element is parent[row,col] and whose rows are ld elements apart.
+ **/
+static void matrixViewPoint(Matrix *view, Matrix *parent, int row, int col, int n, int m, int ld){
+    const long offset = (long) row * parent->ld + col;
+
+    view->mat = NULL;
+    view->fmat = NULL;
+    if(parent->type == MATRIX_FLOAT32){
+        view->fmat = parent->fmat + offset;
+    }else{
+        view->mat = parent->mat + offset;
+    }
+
+    view->n = n;
+    view->m = m;
+    view->ld = ld;
+    view->type = parent->type;
+    view->owner = 0;
+}
+
+/**
+ * Creates an n x m view whose first element is parent[row,col] and whose rows are ld elements apart.
+ **/
+static Matrix *matrixViewCreate(Matrix *parent, int row, int col, int n, int m, int ld){
+    Matrix *view = calloc(1, sizeof(Matrix));
+
+    if(view == NULL){
+        printf("Error making matrix view. Insufficient space. Exiting.\n");
+        exit(0);
+    }
+
+    matrixViewPoint(view, parent, row, col, n, m, ld);
+    return view;
 }
 
 int matrixGetM(Matrix *a){
@@ -38,120 +545,151 @@ int matrixGetN(Matrix *a){
         return -1;
     return a->n;
 }
+char matrixGetType(Matrix *a){
+    if(a == NULL)
+        return -1;
+    return a->type;
+}
+
 double matrixGetValue(Matrix *a, int n, int m){
-    if(a == NULL  || a->mat == NULL || n < 0 || m < 0 || n >= a->n || m >= a->m)
+    if(a == NULL  || (a->mat == NULL && a->fmat == NULL) || n < 0 || m < 0 || n >= a->n || m >= a->m)
         return NAN;
-    return *(a->mat + (n * a->m) + m);
+    return matrixLoad(a, ((long) n * a->ld) + m);
 }
 
 void matrixSetValue(Matrix *a, int n, int m, double value){
-    if(a != NULL && a->mat != NULL && !isnan(value) && n >= 0 && m >= 0 && n < a->n && m < a->m)
-        *(a->mat + (n * a->m) + m) = value;
+    if(a != NULL && (a->mat != NULL || a->fmat != NULL) && !isnan(value) && n >= 0 && m >= 0 && n < a->n && m < a->m)
+        matrixStore(a, ((long) n * a->ld) + m, value);
 }
 
 double matrixGetNext(Matrix *a, int index){
     if(a == NULL) return NAN;
     
     if(index == -1){
-        if(a->matIter != a->matEnd){
-            return *(a->matIter++);
+        if(a->iter < a->n * a->m){
+            return matrixLoad(a, matrixOffset(a, a->iter++));
         }else{
-            a->matIter = a->mat;
+            a->iter = 0;
         }
     }else if(index >= 0 && index < a->n * a->m){
-        a->matIter = a->mat + index;
-        return *(a->matIter++);
+        a->iter = index;
+        return matrixLoad(a, matrixOffset(a, a->iter++));
     }
     
     return NAN;
 }
 
 void matrixResetIter(Matrix *a){
-    if(a != NULL && a->mat != NULL) a->matIter = a->mat;
+    if(a != NULL) a->iter = 0;
+}
+
+int matrixNonZeroRows(Matrix *a, int *rows){
+    if(a == NULL || rows == NULL) return -1;
+    
+    int i, j, count = 0;
+    
+    for(i = 0; i < a->n; i++){
+        const long row = (long) i * a->ld;
+        
+        if(a->type == MATRIX_FLOAT32){
+            for(j = 0; j < a->m && a->fmat[row + j] == 0; j++);
+        }else{
+            for(j = 0; j < a->m && a->mat[row + j] == 0; j++);
+        }
+        if(j < a->m) rows[count++] = i;
+    }
+    
+    return count;
 }
 
 
 void matrixSetPrevious(Matrix *a, double value){    
-    if(a != NULL && a->mat != NULL && !isnan(value) && a->matIter > a->mat && a->matIter <= a->matEnd){
-        *(a->matIter - 1) = value;
+    if(a != NULL && !isnan(value) && a->iter > 0 && a->iter <= a->n * a->m){
+        matrixStore(a, matrixOffset(a, a->iter - 1), value);
     }
 }
 
 
-Matrix *matrixMul(Matrix *a, Matrix *b, Matrix *c, char flags){
-   if(a == NULL || b == NULL || a == c || b == c || flags < 0 || flags > 23) return NULL;
-    
-    /**
-     * Set up the variables that specify the iteration through Matrix a.
-     * 
-     * If the Matrix is meant to be transposed, we modify the values accordingly.
-     **/
-    int aLoopStep = a->m, aDPStep = 1;
-    double *aCurr = a->mat, *aDPLimit = aCurr + aLoopStep, *aLimit = a->matEnd;
-    
-    if(flags & MATRIX_A_TRANS){
-        aDPStep = aLoopStep;
-        aLoopStep = 1;
-        aDPLimit = aLimit;
-        aLimit = aCurr + aDPStep;
+Matrix *matrixMap(Matrix *a, Matrix *c, int op){
+    if(a == NULL || op < MATRIX_MAP_COPY || op > MATRIX_MAP_SQRT) return NULL;
+
+    if(c == NULL){
+        c = matrixAllocate(a->n, a->m, a->type);
+    }else if(c->n != a->n || c->m != a->m){
+        fprintf(stderr, "Error in matrixMap. [%d,%d] vs [%d,%d].\n", a->n, a->m, c->n, c->m);
+        return NULL;
     }
-    
+
+    matrixElementRun(a, NULL, c, op);
+    return c;
+}
+
+void matrixMapInPlace(Matrix *a, int op){
+    matrixMap(a, a, op);
+}
+
+Matrix *matrixZip(Matrix *a, Matrix *b, Matrix *c, int op){
+    if(a == NULL || b == NULL || op < MATRIX_ZIP_ADD || op > MATRIX_ZIP_DER_RELU) return NULL;
+
+    if(b->n != a->n || b->m != a->m){
+        fprintf(stderr, "Error in matrixZip. [%d,%d] vs [%d,%d].\n", a->n, a->m, b->n, b->m);
+        return NULL;
+    }
+    if(c == NULL){
+        c = matrixAllocate(a->n, a->m, a->type);
+    }else if(c->n != a->n || c->m != a->m){
+        fprintf(stderr, "Error in matrixZip. [%d,%d] vs [%d,%d].\n", a->n, a->m, c->n, c->m);
+        return NULL;
+    }
+
+    matrixElementRun(a, b, c, op);
+    return c;
+}
+
+void matrixZipInPlace(Matrix *a, Matrix *b, int op){
+    matrixZip(a, b, a, op);
+}
+
+Matrix *matrixMul(Matrix *a, Matrix *b, Matrix *c, char flags){
+    if(a == NULL || b == NULL || a == c || b == c || flags < 0 || flags > 23) return NULL;
+
     /**
-     * Set up the variables that specify the iteration through Matrix b.
+     * Find the shapes of op(A) (rows x inner) and op(B) (inner x cols).
      * 
-     * If the Matrix is meant to be transposed, we modify the values accordingly.
-     * At this point, we can check to see if Matrix a and Matrix b can be multiplied to one another (given the Transposition state).
+     * Transposition never moves any data: matrixOperand() swaps the row and column steps instead.
      **/
-    int bLoopStep = 1, bDPStep = b->m;
-    double *bCurr, *bLimit = b->mat + bDPStep;
-    
-    if(flags & MATRIX_B_TRANS){
-        if(b->m != (flags & MATRIX_A_TRANS ? a->n : aLoopStep)){
-            fprintf(stderr, "Matrix A and B don't correspond\n");
-            return NULL;
-        }
-        bLoopStep = bDPStep;
-        bDPStep = 1;
-        bLimit = b->matEnd;
-    }else if(b->n != (flags & MATRIX_A_TRANS ? a->n : aLoopStep)){
+    const int rows = flags & MATRIX_A_TRANS ? a->m : a->n;
+    const int inner = flags & MATRIX_A_TRANS ? a->n : a->m;
+    const int bInner = flags & MATRIX_B_TRANS ? b->m : b->n;
+    const int cols = flags & MATRIX_B_TRANS ? b->n : b->m;
+
+    if(bInner != inner){
         fprintf(stderr, "Matrix A and B don't correspond\n");
         return NULL;
     }
-    
+
     /**
-     * Set up the variables that specify the iteration through Matrix c.
+     * Check Matrix c against the product.
      * 
-     * If the Matrix is meant to be transposed, we modify the values accordingly.
+     * If c isn't given, one of the element type of a is created.
      * At this point, we can check to see if the resulting Matrix from multiplying a and b will be the same dimension as Matrix c (given the Transposition state).
      **/
-    int cInnerStep = 1, cOuterStep = 0;
     if(c == NULL){
-        int n = flags & MATRIX_A_TRANS ? aDPStep : a->n;
-        int m = flags & MATRIX_B_TRANS ? b->n : bDPStep;
         if(flags & MATRIX_C_TRANS){
-            c = matrixCreate(m, n, NULL, n * m);
-            cInnerStep = n;
-            cOuterStep = 1 - (m * n);
+            c = matrixAllocate(cols, rows, a->type);
         }else{
-            c = matrixCreate(n, m, NULL, n * m);
+            c = matrixAllocate(rows, cols, a->type);
         }
-        
-        if(c == NULL) return NULL;
-    }else{
-        if(flags & MATRIX_C_TRANS){
-            if(c->m != (flags & MATRIX_A_TRANS ? aDPStep : a->n) || c->n != (flags & MATRIX_B_TRANS ? b->n : bDPStep)){
-                fprintf(stderr, "Matrix C(T) doesn't correspond with A or B\n");
-                return NULL;
-            }
-            cInnerStep = c->m;
-            cOuterStep = 1 - (cInnerStep * c->n);
-        }else if(c->n != (flags & MATRIX_A_TRANS ? aDPStep : a->n) || c->m != (flags & MATRIX_B_TRANS ? b->n : bDPStep)){
-            fprintf(stderr, "Matrix C [%d,%d] doesn't correspond with A[%d,%d] or B [%d,%d]\n", c->n, c->m, a->n, a->m, b->n,b->m);
+    }else if(flags & MATRIX_C_TRANS){
+        if(c->m != rows || c->n != cols){
+            fprintf(stderr, "Matrix C(T) doesn't correspond with A or B\n");
             return NULL;
         }
+    }else if(c->n != rows || c->m != cols){
+        fprintf(stderr, "Matrix C [%d,%d] doesn't correspond with A[%d,%d] or B [%d,%d]\n", c->n, c->m, a->n, a->m, b->n,b->m);
+        return NULL;
     }
-    double *cCurr = c->mat;
-    
+
     /**
      * Decide what to do with the result with respect to Matrix c.
      * 
@@ -163,80 +701,123 @@ Matrix *matrixMul(Matrix *a, Matrix *b, Matrix *c, char flags){
      * 
      * FORM: c = c (+/-) (a * b)
      **/
-    void (*op)(double *, double) = setOp;
-    
+    double alpha = 1, beta = 0;
+
     if(flags & MATRIX_RESULT_ADD){
-        op = addOp;
+        beta = 1;
     }else if(flags & MATRIX_RESULT_SUB){
-        op = subOp;
-    }
-    
-    for(;aCurr < aLimit; aCurr += aLoopStep, aDPLimit += aLoopStep){
-        for(bCurr = b->mat;bCurr < bLimit; bCurr += bLoopStep){
-            op(cCurr, dotProd(aCurr, aDPStep, bCurr, bDPStep, aDPLimit));
-            cCurr += cInnerStep;
-        }
-        cCurr += cOuterStep;
+        alpha = -1;
+        beta = 1;
     }
-    
+
+    MatrixMulTask task = {.a = matrixOperand(a, flags & MATRIX_A_TRANS), .b = matrixOperand(b, flags & MATRIX_B_TRANS), .c = matrixOperand(c, flags & MATRIX_C_TRANS),
+                          .rows = rows, .cols = cols, .inner = inner, .alpha = alpha, .beta = beta, .colBlock = 1};
+
+    //Split the output row blocks across the pool (or columns, when the result is a single wide row)
+    matrixMulRun(&task, flags & MATRIX_C_TRANS);
+
     return c;
-    
-    
-    /*int aLStep = a->m, aDStep = 1, bLStep = 1, bDStep = b->m, cLStep = 1, cRStep = 0;
-    double *aMat = a->mat, *bMat = b->mat, *cMat = c->mat, *aStop = a->matEnd, *bStop = b->matEnd, *aHalt = aMat + aLStep;
-    void (*op)(double *, double) = setOp;
-    
-    if(flags & 4){
-        cLStep = c->m;
-        cRStep = (cLStep * c->n) - 1;
-        if((flags & 1 && aLStep != cLStep) || (!(flags & 1) && a->n != cLStep) ||(flags & 2 && b->n != c->n) || (!(flags & 2) && bDStep != c->n)){
-            return NULL;
-        }
-    }else if((flags & 1 && aLStep != c->n) || (!(flags & 1) && a->n != c->n) ||(flags & 2 && b->n != c->m) || (!(flags & 2) && bDStep != c->m)){
+}
+
+void matrixSGDUpdate(Matrix *w, Matrix *g, double rate, Matrix *shadow){
+    if(w == NULL || g == NULL) return;
+
+    MatrixUpdateTask task = {w, NULL, NULL, g, shadow, 0, 0, 0, MATRIX_UPDATE_SGD, {rate, 0, 0, 0}};
+    matrixUpdateRun(&task);
+}
+
+void matrixMomentumUpdate(Matrix *w, Matrix *velocity, Matrix *g, double momentum, double rate, Matrix *shadow){
+    if(w == NULL || velocity == NULL || g == NULL) return;
+
+    MatrixUpdateTask task = {w, velocity, NULL, g, shadow, 0, 0, 0, MATRIX_UPDATE_MOMENTUM, {momentum, rate, 0, 0}};
+    matrixUpdateRun(&task);
+}
+
+void matrixRMSPropUpdate(Matrix *w, Matrix *square, Matrix *g, double decay, double rate, double eps, Matrix *shadow){
+    if(w == NULL || square == NULL || g == NULL) return;
+
+    MatrixUpdateTask task = {w, NULL, square, g, shadow, 0, 0, 0, MATRIX_UPDATE_RMSPROP, {decay, rate, eps, 0}};
+    matrixUpdateRun(&task);
+}
+
+void matrixAdamUpdate(Matrix *w, Matrix *mean, Matrix *square, Matrix *g, double beta1, double beta2, double rate, double eps, long step, Matrix *shadow){
+    if(w == NULL || mean == NULL || square == NULL || g == NULL || step < 1) return;
+
+    //Bias correction of both moments folded into the step size
+    const double corrected = rate * sqrt(1 - pow(beta2, step)) / (1 - pow(beta1, step));
+    MatrixUpdateTask task = {w, mean, square, g, shadow, 0, 0, 0, MATRIX_UPDATE_ADAM, {beta1, beta2, corrected, eps}};
+    matrixUpdateRun(&task);
+}
+
+Matrix *matrixReduceCols(Matrix *a, Matrix *c, char flags){
+    if(a == NULL || a == c) return NULL;
+
+    if(c == NULL){
+        c = matrixAllocate(a->n, 1, a->type);
+    }else if(c->n != a->n || c->m != 1){
+        fprintf(stderr, "Error in matrixReduceCols. [%d,%d] can't hold the row sums of [%d,%d].\n", c->n, c->m, a->n, a->m);
         return NULL;
     }
-    
-    if(flags & 1){
-        aDStep = aLStep;
-        aLStep = 1;
-        aHalt = aStop;
-        aStop = aMat + aDStep;
+
+    double alpha = 1, beta = 0;
+
+    if(flags & MATRIX_RESULT_ADD){
+        beta = 1;
+    }else if(flags & MATRIX_RESULT_SUB){
+        alpha = -1;
+        beta = 1;
     }
-    
-    if(flags & 2){
-        bLStep = bDStep;
-        bDStep = 1;
-        bStop = bMat + b->n;
+
+    //a times a column of ones, which zero strides make out of a single element
+    static const double one = 1;
+    GemmOperand ones = {(void *) &one, 0, 0, MATRIX_FLOAT64};
+    MatrixMulTask task = {.a = matrixOperand(a, 0), .b = ones, .c = matrixOperand(c, 0), .rows = a->n, .cols = 1, .inner = a->m,
+                          .alpha = alpha, .beta = beta, .colBlock = 1};
+
+    matrixMulRun(&task, 0);
+
+    return c;
+}
+
+Matrix *matrixMulBiasActivate(Matrix *w, Matrix *x, Matrix *bias, Matrix *z, Matrix *a, int activation){
+    if(w == NULL || x == NULL || a == NULL || w == a || x == a || (z != NULL && (z == w || z == x || z == a))) return NULL;
+
+    const int rows = w->n, cols = x->m, inner = w->m;
+
+    if(x->n != inner || a->n != rows || a->m != cols || (z != NULL && (z->n != rows || z->m != cols))){
+        fprintf(stderr, "Error in matrixMulBiasActivate. W[%d,%d] * X[%d,%d] doesn't correspond with A[%d,%d].\n", w->n, w->m, x->n, x->m, a->n, a->m);
+        return NULL;
     }
-    
-    if(flags & 8){
-        if(flags & 24){
-            return NULL;
-        }
-        op = addOp;
-    }else if(flags & 16){
-        op = subOp;
+    if(bias != NULL && (bias->n != rows || (bias->m != 1 && bias->m != cols))){
+        fprintf(stderr, "Error in matrixMulBiasActivate. Bias [%d,%d] doesn't correspond with [%d,%d].\n", bias->n, bias->m, rows, cols);
+        return NULL;
     }
-    
-    for(;aMat < aStop; aMat += aLStep, aHalt += aLStep){
-        for(bMat = b->mat; bMat < bStop; bMat += bLStep){
-            op(cMat, dotProd(aMat, aDStep, bMat, bDStep, aHalt));
-            cMat += cLStep;
-        }
-        cMat -= cRStep;
+    if(activation != ACTIV_FUNC_SIGMOID && activation != ACTIV_FUNC_RELU) activation = GEMM_ACTIV_NONE;
+
+    //z (when kept) is the GEMM output and a gets the activation on the side; otherwise a is activated in place
+    Matrix *c = z != NULL ? z : a;
+    MatrixMulTask task = {.a = matrixOperand(w, 0), .b = matrixOperand(x, 0), .c = matrixOperand(c, 0), .rows = rows, .cols = cols, .inner = inner,
+                          .alpha = 1, .beta = 0, .colBlock = 1, .fused = 1};
+
+    task.epi.activation = activation;
+    if(bias != NULL){
+        task.epi.bias = matrixOperand(bias, 0);
+        if(bias->m == 1) task.epi.bias.colStep = 0;  /*Broadcast the column over every column of the result*/
     }
-    
-    return c;*/
+    if(z != NULL){
+        task.epi.out = matrixOperand(a, 0);
+    }
+
+    matrixMulRun(&task, 0);
+
+    return a;
 }
 
 Matrix *matrixAdd(Matrix *a, Matrix *b, Matrix *c, char flags){
     if(a == NULL || b == NULL || c == NULL) return NULL;
-    int aStep = 1, bStep = 1, cStep = 1, aOff = 0, bOff = 0, cOff = 0, n = c->n, m = c->m;
-    double *aMat = a->mat, *bMat = b->mat, *cMat = c->mat;
+    int n = c->n, m = c->m;
 
     if(flags & 4){
-        cStep = c->m;
-        cOff = (c->m * c->n) - 1;
         n = c->m;
         m = c->n;
     }
@@ -246,8 +827,6 @@ Matrix *matrixAdd(Matrix *a, Matrix *b, Matrix *c, char flags){
             printf("I dipped matAdd.\n");
             return NULL;
         }
-        aStep = a->m;
-        aOff = (a->m * a->n) - 1;
     }else if(a->n != n || a->m != m){
         printf("I dipped2 matAdd.\n");
         return NULL;
@@ -258,8 +837,6 @@ Matrix *matrixAdd(Matrix *a, Matrix *b, Matrix *c, char flags){
             printf("I dipped3 matAdd.\n");
             return NULL;
         }
-        bStep = b->m;
-        bOff = (b->m * b->n) - 1;
     }else if(b->n != n || b->m != m){
         if(b->n != n)
             fprintf(stderr, "Error in matrixAdd. b->n != c->n (%d vs %d).\n", b->n, n);
@@ -268,25 +845,16 @@ Matrix *matrixAdd(Matrix *a, Matrix *b, Matrix *c, char flags){
         return NULL;
     }
 
-    int i,j;
-    
-    for(i = 0; i < n; i++, aMat -= aOff, bMat -= bOff, cMat -= cOff){
-        for(j = 0; j < m; j++, aMat += aStep, bMat += bStep, cMat += cStep){
-            *cMat = *bMat + *aMat;
-        }
-    }
+    matrixAddRun(a, b, c, flags, n, m, 0);
     return c;
 }
 
 
 Matrix *matrixSub(Matrix *a, Matrix *b, Matrix *c, char flags){
     if(a == NULL || b == NULL || c == NULL) return NULL;
-    int aStep = 1, bStep = 1, cStep = 1, aOff = 0, bOff = 0, cOff = 0, n = c->n, m = c->m;
-    double *aMat = a->mat, *bMat = b->mat, *cMat = c->mat;
+    int n = c->n, m = c->m;
 
     if(flags & 4){
-        cStep = c->m;
-        cOff = (c->m * c->n) - 1;
         n = c->m;
         m = c->n;
     }
@@ -296,8 +864,6 @@ Matrix *matrixSub(Matrix *a, Matrix *b, Matrix *c, char flags){
             printf("I dipped matAdd.\n");
             return NULL;
         }
-        aStep = a->m;
-        aOff = (a->m * a->n) - 1;
     }else if(a->n != n || a->m != m){
         printf("I dipped2 matAdd.\n");
         return NULL;
@@ -308,8 +874,6 @@ Matrix *matrixSub(Matrix *a, Matrix *b, Matrix *c, char flags){
             printf("I dipped3 matAdd.\n");
             return NULL;
         }
-        bStep = b->m;
-        bOff = (b->m * b->n) - 1;
     }else if(b->n != n || b->m != m){
         if(b->n != n)
             fprintf(stderr, "Error in matrixSub. b->n != c->n (%d vs %d).\n", b->n, n);
@@ -318,54 +882,215 @@ Matrix *matrixSub(Matrix *a, Matrix *b, Matrix *c, char flags){
         return NULL;
     }
 
-    int i,j;
-    
-    for(i = 0; i < n; i++, aMat -= aOff, bMat -= bOff, cMat -= cOff){
-        for(j = 0; j < m; j++, aMat += aStep, bMat += bStep, cMat += cStep){
-            *cMat = *aMat - *bMat;
-        }
-    }
+    matrixAddRun(a, b, c, flags, n, m, 1);
     return c;
 }
 
 Matrix *matrixCreate(int n, int m, double *values, int valuesLen){
     if(n * m != valuesLen || !n || !m) return NULL;
 
-    Matrix *matrix = calloc(1, sizeof(Matrix));
- 
-    if(matrix == NULL){
-        printf("Error making matrix. Insufficient space. Exiting.\n");
-        exit(0);
+    Matrix *matrix = matrixAllocate(n, m, MATRIX_FLOAT64);
+
+    if(values != NULL){
+        int i;
+        for(i = 0; i < n; i++){
+            memcpy(matrix->mat + (long) i * matrix->ld, values + (long) i * m, m * sizeof(double));
+        }
     }
 
-    matrix->mat = (double *) calloc(valuesLen, sizeof(double));
+    return matrix;
+}
+
+Matrix *matrixCreateF(int n, int m, float *values, int valuesLen){
+    if(n * m != valuesLen || !n || !m) return NULL;
+
+    Matrix *matrix = matrixAllocate(n, m, MATRIX_FLOAT32);
 
-    if(matrix->mat == NULL){
-        printf("Error making matrix list. Insufficient space. Exiting.\n");
-        exit(0);
-    }
     if(values != NULL){
         int i;
-        for(i = 0; i < valuesLen; i++){
-            matrix->mat[i] = values[i];
+        for(i = 0; i < n; i++){
+            memcpy(matrix->fmat + (long) i * matrix->ld, values + (long) i * m, m * sizeof(float));
         }
     }
 
-    matrix->n = n;
-    matrix->m = m;
-    matrix->matIter = matrix->mat;
-    matrix->matEnd = matrix->mat + valuesLen;
     return matrix;
 }
 
-double *matrixDestroy(Matrix *matrix, char flags){
+Matrix *matrixConvert(Matrix *a, Matrix *c, char type){
+    if(a == NULL || (type != MATRIX_FLOAT64 && type != MATRIX_FLOAT32)) return NULL;
+
+    if(c == NULL){
+        c = matrixAllocate(a->n, a->m, type);
+    }else if(c->n != a->n || c->m != a->m){
+        fprintf(stderr, "Error in matrixConvert. [%d,%d] vs [%d,%d].\n", a->n, a->m, c->n, c->m);
+        return NULL;
+    }
+
+    if(a == c) return c;
+
+    const int m = a->m;
+    long i;
+    int j;
+
+    for(i = 0; i < a->n; i++){
+        if(a->type == c->type){
+            memcpy(matrixRow(c, i), matrixRow(a, i), m * (a->type == MATRIX_FLOAT32 ? sizeof(float) : sizeof(double)));
+        }else if(c->type == MATRIX_FLOAT32){
+            float *cRow = c->fmat + i * c->ld;
+            const double *aRow = a->mat + i * a->ld;
+            for(j = 0; j < m; j++) cRow[j] = (float) aRow[j];
+        }else{
+            double *cRow = c->mat + i * c->ld;
+            const float *aRow = a->fmat + i * a->ld;
+            for(j = 0; j < m; j++) cRow[j] = aRow[j];
+        }
+    }
+
+    return c;
+}
+
+Matrix *matrixView(Matrix *parent, int row, int col, int n, int m){
+    if(parent == NULL || n < 1 || m < 1 || row < 0 || col < 0 || row + n > parent->n || col + m > parent->m){
+        fprintf(stderr, "Error in matrixView. Block [%d,%d] + [%d,%d] outside of [%d,%d].\n", row, col, n, m, parent == NULL ? 0 : parent->n, parent == NULL ? 0 : parent->m);
+        return NULL;
+    }
+
+    return matrixViewCreate(parent, row, col, n, m, parent->ld);
+}
+
+Matrix *matrixViewMove(Matrix *view, Matrix *parent, int row, int col, int n, int m){
+    if(view == NULL || view->owner){
+        fprintf(stderr, "Error in matrixViewMove. Only views can be moved.\n");
+        return NULL;
+    }
+    if(parent == NULL || n < 1 || m < 1 || row < 0 || col < 0 || row + n > parent->n || col + m > parent->m){
+        fprintf(stderr, "Error in matrixViewMove. Block [%d,%d] + [%d,%d] outside of [%d,%d].\n", row, col, n, m, parent == NULL ? 0 : parent->n, parent == NULL ? 0 : parent->m);
+        return NULL;
+    }
+
+    matrixViewPoint(view, parent, row, col, n, m, parent->ld);
+    return view;
+}
+
+Matrix *matrixViewRows(Matrix *parent, int row, int n, int step){
+    if(parent == NULL || n < 1 || step < 1 || row < 0 || row + (long) (n - 1) * step >= parent->n){
+        fprintf(stderr, "Error in matrixViewRows. Rows %d + %d * %d outside of %d.\n", row, n, step, parent == NULL ? 0 : parent->n);
+        return NULL;
+    }
+
+    return matrixViewCreate(parent, row, 0, n, parent->m, n == 1 ? parent->ld : parent->ld * step);
+}
+
+Matrix *matrixViewVector(Matrix *parent, int row){
+    if(parent == NULL || row < 0 || row >= parent->n){
+        fprintf(stderr, "Error in matrixViewVector. Row %d outside of %d.\n", row, parent == NULL ? 0 : parent->n);
+        return NULL;
+    }
+
+    //A row is contiguous, so read as a column its elements are one apart
+    return matrixViewCreate(parent, row, 0, parent->m, 1, 1);
+}
+
+long matrixArenaSize(int n, int m, char type){
+    if(n < 1 || m < 1) return 0;
+
+    //Rounded up to whole vectors so that the next block is aligned too
+    const int lanes = matrixLanes(type);
+    return (((long) n * matrixLd(m, type) + lanes - 1) / lanes) * lanes;
+}
+
+Matrix *matrixViewArena(Matrix *arena, long offset, int n, int m){
+    if(arena == NULL || n < 1 || m < 1 || offset < 0 || offset % matrixLanes(arena->type) || offset + matrixArenaSize(n, m, arena->type) > (long) arena->n * arena->ld){
+        fprintf(stderr, "Error in matrixViewArena. Block [%d,%d] at %ld doesn't fit an aligned spot of [%d,%d].\n", n, m, offset, arena == NULL ? 0 : arena->n, arena == NULL ? 0 : arena->m);
+        return NULL;
+    }
+
+    //Laid out like a matrix of its own, padding included, so kernels see the same strides either way
+    return matrixViewCreate(arena, (int) (offset / arena->ld), (int) (offset % arena->ld), n, m, matrixLd(m, arena->type));
+}
+
+Matrix *matrixViewMemory(void *values, int n, int m, char type){
+    if(values == NULL || n < 1 || m < 1 || (type != MATRIX_FLOAT64 && type != MATRIX_FLOAT32) || (size_t) values % MATRIX_ALIGN){
+        fprintf(stderr, "Error in matrixViewMemory. Storage must be non NULL and %d byte aligned, and the type a matrix type.\n", MATRIX_ALIGN);
+        return NULL;
+    }
+
+    Matrix *view = calloc(1, sizeof(Matrix));
+
+    if(view == NULL){
+        printf("Error making matrix view. Insufficient space. Exiting.\n");
+        exit(0);
+    }
+
+    if(type == MATRIX_FLOAT32){
+        view->fmat = (float *) values;
+    }else{
+        view->mat = (double *) values;
+    }
+
+    //Same strides as matrixAllocate() would give, owner 0 so the caller's storage is never freed
+    view->n = n;
+    view->m = m;
+    view->ld = matrixLd(m, type);
+    view->type = type;
+    view->owner = 0;
+    return view;
+}
+
+long matrixWriteRaw(Matrix *a, FILE *file){
+    if(a == NULL || file == NULL) return -1;
+
+    static const char zeros[MATRIX_ALIGN] = {0};
+    const size_t eSize = a->type == MATRIX_FLOAT32 ? sizeof(float) : sizeof(double);
+    const size_t padding = (size_t) (matrixLd(a->m, a->type) - a->m) * eSize;
+    long row;
+
+    //Rows as matrixViewMemory() expects them, the padding zeroed rather than whatever a's own holds
+    for(row = 0; row < a->n; row++){
+        if(fwrite(matrixRow(a, row), eSize, a->m, file) != (size_t) a->m || (padding && fwrite(zeros, 1, padding, file) != padding)){
+            fprintf(stderr, "Error in matrixWriteRaw. Couldn't write row %ld.\n", row);
+            return -1;
+        }
+    }
+
+    return (long) a->n * (a->m * eSize + padding);
+}
+
+long matrixReadRaw(Matrix *a, FILE *file){
+    if(a == NULL || file == NULL) return -1;
+
+    const size_t eSize = a->type == MATRIX_FLOAT32 ? sizeof(float) : sizeof(double);
+    const size_t padding = (size_t) (matrixLd(a->m, a->type) - a->m) * eSize;
+    long row;
+
+    for(row = 0; row < a->n; row++){
+        if(fread(matrixRow(a, row), eSize, a->m, file) != (size_t) a->m || (padding && fseek(file, (long) padding, SEEK_CUR))){
+            fprintf(stderr, "Error in matrixReadRaw. Couldn't read row %ld.\n", row);
+            return -1;
+        }
+    }
+
+    return (long) a->n * (a->m * eSize + padding);
+}
+
+void *matrixDestroy(Matrix *matrix, char flags){
     if(matrix == NULL) return NULL;
-    double *list = NULL;
+    void *list = NULL;
 
-    if(flags & 1){
-        list = matrix->mat;
+    if(!matrix->owner){
+        //Views never hand out (or free) their parent's storage
+    }else if(flags & 1){
+        //The caller gets the values back packed, so drop the row padding first
+        const size_t rowBytes = matrix->m * (matrix->type == MATRIX_FLOAT32 ? sizeof(float) : sizeof(double));
+        long i;
+
+        list = matrixRow(matrix, 0);
+        for(i = 1; matrix->ld != matrix->m && i < matrix->n; i++){
+            memmove((char *) list + i * rowBytes, matrixRow(matrix, i), rowBytes);
+        }
     }else{
         free(matrix->mat);
+        free(matrix->fmat);
     }
 
     free(matrix);
@@ -374,24 +1099,11 @@ double *matrixDestroy(Matrix *matrix, char flags){
 }
 
 double dotProd(double *a, long stepA, double *b, long stepB, double *aStop){
-    double sum = 0;
+    if(stepA == 1 && stepB == 1){
+        return a < aStop ? simd.dot(a, b, aStop - a) : 0;
+    }
 
-    /*asm volatile(
-        "pxor %%xmm0, %%xmm0\n\t"
-        "jmp 2f\n\t"
-        "1: movsd (%1), %%xmm1\n\t"
-        "movsd (%3), %%xmm2\n\t"
-        "mulsd %%xmm1, %%xmm2\n\t"
-        "addsd %%xmm2, %%xmm0\n\t"
-        "addq %2, %1\n\t"
-        "addq %4, %3\n\t"
-        "2: cmpq %1, %5\n\t"
-        "jg 1b\n\t"
-        "movq %%xmm0, %0\n\t"
-        : "=r" (sum)
-        : "D" (a), "S" (stepA * 8), "d" (b), "r" (stepB * 8), "r" (aStop)
-        :"%xmm0", "%xmm1", "%xmm2"
-    );*/
+    double sum = 0;
 
     while(a < aStop){
         sum += *a * *b;
@@ -410,7 +1122,7 @@ void matrixPrint(Matrix *a){
         if(a->n <= 20 || (i < 5 || i >= a->n - 5)){
             for(j = 0; j < a->m; j++){
                 if(a->m <= 20 || (j < 5 || j >= a->m - 5))
-                    printf("%10.6lf\t", a->mat[(i * a->m) + j]);
+                    printf("%10.6lf\t", matrixLoad(a, ((long) i * a->ld) + j));
                 else if(j == 5){
                     int k = 3;
                     for(;k > 0; k--){
@@ -449,9 +1161,9 @@ void matrixPrintJSON(Matrix *a, FILE *output){
             fprintf(output, "[");
             for(j = 0; j < a->m - 1; j++){
                 //if(a->m > 20 && (j < 5 || j >= a->m - 5))
-                    fprintf(output, "%10.2lf,", a->mat[(i * a->m) + j]);
+                    fprintf(output, "%10.2lf,", matrixLoad(a, ((long) i * a->ld) + j));
             }
-            fprintf(output, "%10.2lf]", a->mat[((i + 1) * a->m) - 1]);
+            fprintf(output, "%10.2lf]", matrixLoad(a, ((long) i * a->ld) + a->m - 1));
         //}
     }*/
 
@@ -463,7 +1175,7 @@ void matrixPrintJSON(Matrix *a, FILE *output){
             fprintf(output, "[");
             for(j = 0; j < a->m - 1; j++){
                 if(a->m <= 20 || (j < 5 || j >= a->m - 5))
-                    fprintf(output, "%.2lf,", a->mat[(i * a->m) + j]);
+                    fprintf(output, "%.2lf,", matrixLoad(a, ((long) i * a->ld) + j));
                 else if(j == 5){
                     int k = 3;
                     for(;k > 0; k--){
@@ -472,7 +1184,7 @@ void matrixPrintJSON(Matrix *a, FILE *output){
                     j = a->m - 6;
                 }
             }
-            fprintf(output, "%.2lf]", a->mat[((i + 1) * a->m) - 1]);
+            fprintf(output, "%.2lf]", matrixLoad(a, ((long) i * a->ld) + a->m - 1));
         }else if(i == 5){
             if(a->m <= 20){
                 j = a->m;
@@ -495,29 +1207,83 @@ void matrixPrintJSON(Matrix *a, FILE *output){
     }
 }
 
-void matrixConstantAdd(Matrix *a, double c){
-    double *val = a->mat;
-    double *stop = val + (a->m * a->n);
+/**
+ * Applies one of the contiguous SIMD constant kernels to every row, leaving the row padding alone.
+ * Unpadded storage is handled in a single call.
+ **/
+static void matrixConstantRun(Matrix *a, void (*kernel)(double *, double, long), void (*kernelF)(float *, float, long), double c){
+    const long rows = a->ld == a->m ? 1 : a->n;
+    const long len = a->ld == a->m ? (long) a->n * a->m : a->m;
+    long i;
 
-    while(val < stop){
-        *(val++) += c;
+    for(i = 0; i < rows; i++){
+        if(a->type == MATRIX_FLOAT32){
+            kernelF((float *) matrixRow(a, i), (float) c, len);
+        }else{
+            kernel((double *) matrixRow(a, i), c, len);
+        }
     }
 }
 
+void matrixConstantAdd(Matrix *a, double c){
+    matrixConstantRun(a, simd.add, simd.addF, c);
+}
+
 void matrixConstantMul(Matrix *a, double c){
-    double *val = a->mat;
-    double *stop = val + (a->m * a->n);
+    matrixConstantRun(a, simd.mul, simd.mulF, c);
+}
+
+/**
+ * Counter-based random numbers: the counter-th output of a splitmix64 stream started at key, computed directly.
+ * Any element can be drawn on its own, in any order and on any thread, and still get the same bits.
+ **/
+static unsigned long long matrixRandomBits(unsigned long long key, unsigned long long counter){
+    unsigned long long z = key + (counter + 1) * 0x9E3779B97F4A7C15ULL;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+//Logical elements each part of a random fill draws
+#define MATRIX_RANDOM_BLOCK 4096
+
+typedef struct{
+    Matrix *a;
+    unsigned long long key;
+    double low, scale;
+} MatrixRandomTask;
 
-    while(val < stop){
-        *(val++) *= c;
+static void matrixRandomPart(void *arg, int start, int end){
+    MatrixRandomTask *t = (MatrixRandomTask *) arg;
+    const long total = (long) t->a->n * t->a->m;
+    const long stop = (long) end * MATRIX_RANDOM_BLOCK < total ? (long) end * MATRIX_RANDOM_BLOCK : total;
+    long k;
+
+    for(k = (long) start * MATRIX_RANDOM_BLOCK; k < stop; k++){
+        //53 random bits give a double in [0, 1)
+        const double value = t->low + t->scale * ((matrixRandomBits(t->key, k) >> 11) * (1.0 / 9007199254740992.0));
+        const long index = (k / t->a->m) * t->a->ld + k % t->a->m;
+
+        if(t->a->type == MATRIX_FLOAT32) t->a->fmat[index] = (float) value;
+        else t->a->mat[index] = value;
     }
 }
 
-void matrixSetMat(Matrix *a, double num){
-    double *val = a->mat;
-    double *stop = val + (a->m * a->n);
+void matrixFillUniform(Matrix *a, double low, double high, unsigned long seed, unsigned long stream){
+    if(a == NULL) return;
+
+    MatrixRandomTask task = {a, matrixRandomBits(seed, stream), low, high - low};
+    const long total = (long) a->n * a->m;
+    const int parts = (int) ((total + MATRIX_RANDOM_BLOCK - 1) / MATRIX_RANDOM_BLOCK);
 
-    while(val < stop){
-        *(val++) = num;
+    if(threadPoolWorthIt((double) total)){
+        threadPoolRun(matrixRandomPart, &task, parts);
+    }else{
+        matrixRandomPart(&task, 0, parts);
     }
 }
+
+void matrixSetMat(Matrix *a, double num){
+    matrixConstantRun(a, simd.set, simd.setF, num);
+}
@@ -0,0 +1,433 @@
+/**
+ * SIMD file holding the vectorized dot product and elementwise kernels used by the Matrix functions.
+ *
+ * Each kernel has a scalar, SSE2, AVX2+FMA and AVX-512 version, for both double and float. The versions are compiled
+ * with per-function target attributes so the binary itself only assumes the baseline ISA; simdDetectLevel() reads
+ * CPUID (and XGETBV for the OS side of AVX) once at startup and the widest supported set is installed into the simd table.
+ *
+ * Author: Fabio Hux
+ *
+ * Date Created: October 2026
+ *
+ * Date Last Edited: 10/17/2026
+ */
+#include <stdlib.h>
+#include "components/simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+
+/**
+ * Scalar kernels (fallback for anything that isn't x86)
+ **/
+
+static double dotScalar(const double *a, const double *b, long len){
+    double sum = 0;
+    long i;
+    for(i = 0; i < len; i++){
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static void axpyScalar(double *y, const double *x, double scale, long len){
+    long i;
+    for(i = 0; i < len; i++){
+        y[i] += scale * x[i];
+    }
+}
+
+static void addScalar(double *a, double value, long len){
+    long i;
+    for(i = 0; i < len; i++){
+        a[i] += value;
+    }
+}
+
+static void mulScalar(double *a, double value, long len){
+    long i;
+    for(i = 0; i < len; i++){
+        a[i] *= value;
+    }
+}
+
+static void setScalar(double *a, double value, long len){
+    long i;
+    for(i = 0; i < len; i++){
+        a[i] = value;
+    }
+}
+
+#ifdef SIMD_X86
+
+/**
+ * SSE2 kernels
+ **/
+
+__attribute__((target("sse2")))
+static double dotSse2(const double *a, const double *b, long len){
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    long i = 0;
+
+    for(; i + 4 <= len; i += 4){
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    s0 = _mm_add_pd(s0, s1);
+
+    double sum = _mm_cvtsd_f64(_mm_add_sd(s0, _mm_unpackhi_pd(s0, s0)));
+    for(; i < len; i++){
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+__attribute__((target("sse2")))
+static void axpySse2(double *y, const double *x, double scale, long len){
+    const __m128d s = _mm_set1_pd(scale);
+    long i = 0;
+
+    for(; i + 2 <= len; i += 2){
+        _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i), _mm_mul_pd(s, _mm_loadu_pd(x + i))));
+    }
+    for(; i < len; i++){
+        y[i] += scale * x[i];
+    }
+}
+
+__attribute__((target("sse2")))
+static void addSse2(double *a, double value, long len){
+    const __m128d v = _mm_set1_pd(value);
+    long i = 0;
+
+    for(; i + 2 <= len; i += 2){
+        _mm_storeu_pd(a + i, _mm_add_pd(_mm_loadu_pd(a + i), v));
+    }
+    for(; i < len; i++){
+        a[i] += value;
+    }
+}
+
+__attribute__((target("sse2")))
+static void mulSse2(double *a, double value, long len){
+    const __m128d v = _mm_set1_pd(value);
+    long i = 0;
+
+    for(; i + 2 <= len; i += 2){
+        _mm_storeu_pd(a + i, _mm_mul_pd(_mm_loadu_pd(a + i), v));
+    }
+    for(; i < len; i++){
+        a[i] *= value;
+    }
+}
+
+__attribute__((target("sse2")))
+static void setSse2(double *a, double value, long len){
+    const __m128d v = _mm_set1_pd(value);
+    long i = 0;
+
+    for(; i + 2 <= len; i += 2){
+        _mm_storeu_pd(a + i, v);
+    }
+    for(; i < len; i++){
+        a[i] = value;
+    }
+}
+
+
+/**
+ * AVX2 + FMA kernels
+ **/
+
+__attribute__((target("avx2,fma")))
+static double dotAvx2(const double *a, const double *b, long len){
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd(), s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+    long i = 0;
+
+    //Four independent accumulators to cover the FMA latency
+    for(; i + 16 <= len; i += 16){
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), s0);
+        s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), s1);
+        s2 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 8), _mm256_loadu_pd(b + i + 8), s2);
+        s3 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 12), _mm256_loadu_pd(b + i + 12), s3);
+    }
+    for(; i + 4 <= len; i += 4){
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), s0);
+    }
+    s0 = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+
+    __m128d h = _mm_add_pd(_mm256_castpd256_pd128(s0), _mm256_extractf128_pd(s0, 1));
+    double sum = _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+    for(; i < len; i++){
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static void axpyAvx2(double *y, const double *x, double scale, long len){
+    const __m256d s = _mm256_set1_pd(scale);
+    long i = 0;
+
+    for(; i + 4 <= len; i += 4){
+        _mm256_storeu_pd(y + i, _mm256_fmadd_pd(s, _mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+    }
+    for(; i < len; i++){
+        y[i] += scale * x[i];
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void addAvx2(double *a, double value, long len){
+    const __m256d v = _mm256_set1_pd(value);
+    long i = 0;
+
+    for(; i + 4 <= len; i += 4){
+        _mm256_storeu_pd(a + i, _mm256_add_pd(_mm256_loadu_pd(a + i), v));
+    }
+    for(; i < len; i++){
+        a[i] += value;
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void mulAvx2(double *a, double value, long len){
+    const __m256d v = _mm256_set1_pd(value);
+    long i = 0;
+
+    for(; i + 4 <= len; i += 4){
+        _mm256_storeu_pd(a + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), v));
+    }
+    for(; i < len; i++){
+        a[i] *= value;
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void setAvx2(double *a, double value, long len){
+    const __m256d v = _mm256_set1_pd(value);
+    long i = 0;
+
+    for(; i + 4 <= len; i += 4){
+        _mm256_storeu_pd(a + i, v);
+    }
+    for(; i < len; i++){
+        a[i] = value;
+    }
+}
+
+
+/**
+ * AVX-512 kernels. Tails are handled with masked loads/stores instead of a scalar loop.
+ **/
+
+__attribute__((target("avx512f")))
+static double dotAvx512(const double *a, const double *b, long len){
+    __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd(), s2 = _mm512_setzero_pd(), s3 = _mm512_setzero_pd();
+    long i = 0;
+
+    for(; i + 32 <= len; i += 32){
+        s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), s0);
+        s1 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 8), _mm512_loadu_pd(b + i + 8), s1);
+        s2 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 16), _mm512_loadu_pd(b + i + 16), s2);
+        s3 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 24), _mm512_loadu_pd(b + i + 24), s3);
+    }
+    for(; i + 8 <= len; i += 8){
+        s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), s0);
+    }
+    if(i < len){
+        const __mmask8 mask = (__mmask8) ((1u << (len - i)) - 1);
+        s1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, a + i), _mm512_maskz_loadu_pd(mask, b + i), s1);
+    }
+
+    return _mm512_reduce_add_pd(_mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3)));
+}
+
+__attribute__((target("avx512f")))
+static void axpyAvx512(double *y, const double *x, double scale, long len){
+    const __m512d s = _mm512_set1_pd(scale);
+    long i = 0;
+
+    for(; i + 8 <= len; i += 8){
+        _mm512_storeu_pd(y + i, _mm512_fmadd_pd(s, _mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i)));
+    }
+    if(i < len){
+        const __mmask8 mask = (__mmask8) ((1u << (len - i)) - 1);
+        _mm512_mask_storeu_pd(y + i, mask, _mm512_fmadd_pd(s, _mm512_maskz_loadu_pd(mask, x + i), _mm512_maskz_loadu_pd(mask, y + i)));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void addAvx512(double *a, double value, long len){
+    const __m512d v = _mm512_set1_pd(value);
+    long i = 0;
+
+    for(; i + 8 <= len; i += 8){
+        _mm512_storeu_pd(a + i, _mm512_add_pd(_mm512_loadu_pd(a + i), v));
+    }
+    if(i < len){
+        const __mmask8 mask = (__mmask8) ((1u << (len - i)) - 1);
+        _mm512_mask_storeu_pd(a + i, mask, _mm512_add_pd(_mm512_maskz_loadu_pd(mask, a + i), v));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void mulAvx512(double *a, double value, long len){
+    const __m512d v = _mm512_set1_pd(value);
+    long i = 0;
+
+    for(; i + 8 <= len; i += 8){
+        _mm512_storeu_pd(a + i, _mm512_mul_pd(_mm512_loadu_pd(a + i), v));
+    }
+    if(i < len){
+        const __mmask8 mask = (__mmask8) ((1u << (len - i)) - 1);
+        _mm512_mask_storeu_pd(a + i, mask, _mm512_mul_pd(_mm512_maskz_loadu_pd(mask, a + i), v));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void setAvx512(double *a, double value, long len){
+    const __m512d v = _mm512_set1_pd(value);
+    long i = 0;
+
+    for(; i + 8 <= len; i += 8){
+        _mm512_storeu_pd(a + i, v);
+    }
+    if(i < len){
+        _mm512_mask_storeu_pd(a + i, (__mmask8) ((1u << (len - i)) - 1), v);
+    }
+}
+
+#endif
+
+
+/**
+ * float kernels
+ *
+ * These are written as plain loops and compiled once per target. With -Ofast the compiler vectorizes them
+ * (reduction included) to the full register width of each instruction set.
+ **/
+
+#define SIMD_FLOAT_KERNELS(SUFFIX, ATTR) \
+    ATTR static float dotF##SUFFIX(const float *a, const float *b, long len){ \
+        float sum = 0; \
+        long i; \
+        for(i = 0; i < len; i++) sum += a[i] * b[i]; \
+        return sum; \
+    } \
+    ATTR static void axpyF##SUFFIX(float *y, const float *x, float scale, long len){ \
+        long i; \
+        for(i = 0; i < len; i++) y[i] += scale * x[i]; \
+    } \
+    ATTR static void addF##SUFFIX(float *a, float value, long len){ \
+        long i; \
+        for(i = 0; i < len; i++) a[i] += value; \
+    } \
+    ATTR static void mulF##SUFFIX(float *a, float value, long len){ \
+        long i; \
+        for(i = 0; i < len; i++) a[i] *= value; \
+    } \
+    ATTR static void setF##SUFFIX(float *a, float value, long len){ \
+        long i; \
+        for(i = 0; i < len; i++) a[i] = value; \
+    }
+
+SIMD_FLOAT_KERNELS(Scalar, )
+
+#ifdef SIMD_X86
+SIMD_FLOAT_KERNELS(Sse2, __attribute__((target("sse2"))))
+SIMD_FLOAT_KERNELS(Avx2, __attribute__((target("avx2,fma"))))
+SIMD_FLOAT_KERNELS(Avx512, __attribute__((target("avx512f"))))
+#endif
+
+SimdKernels simd = {dotScalar, axpyScalar, addScalar, mulScalar, setScalar,
+                    dotFScalar, axpyFScalar, addFScalar, mulFScalar, setFScalar, SIMD_SCALAR};
+
+/**
+ * Function to find the widest vector instruction set usable on this host.
+ *
+ * CPUID tells us what the processor implements, but AVX and AVX-512 also need the OS to save the wider
+ * register state on context switches, which is what XGETBV (XCR0) reports.
+ **/
+int simdDetectLevel(void){
+#ifdef SIMD_X86
+    unsigned int eax, ebx, ecx, edx;
+    int level = SIMD_SCALAR;
+
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return level;
+
+    if(edx & bit_SSE2) level = SIMD_SSE2;
+
+    //OSXSAVE is required before we can ask the OS which register states it preserves
+    if(!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX) || !(ecx & bit_FMA)) return level;
+
+    unsigned int xcr0Low, xcr0High;
+    __asm__ volatile("xgetbv" : "=a" (xcr0Low), "=d" (xcr0High) : "c" (0));
+    (void) xcr0High;
+
+    if((xcr0Low & 0x6) != 0x6) return level; //XMM and YMM state
+
+    if(!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return level;
+
+    if(ebx & bit_AVX2) level = SIMD_AVX2;
+
+    if((ebx & bit_AVX512F) && (xcr0Low & 0xe6) == 0xe6) level = SIMD_AVX512; //Opmask and ZMM state
+
+    return level;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+/**
+ * Installs the kernels once, before main() runs, so every call afterwards is a single indirect jump.
+ **/
+__attribute__((constructor))
+static void simdInit(void){
+    simd.level = simdDetectLevel();
+
+#ifdef SIMD_X86
+    switch(simd.level){
+        case SIMD_AVX512:
+            simd.dot = dotAvx512;
+            simd.axpy = axpyAvx512;
+            simd.add = addAvx512;
+            simd.mul = mulAvx512;
+            simd.set = setAvx512;
+            simd.dotF = dotFAvx512;
+            simd.axpyF = axpyFAvx512;
+            simd.addF = addFAvx512;
+            simd.mulF = mulFAvx512;
+            simd.setF = setFAvx512;
+            break;
+        case SIMD_AVX2:
+            simd.dot = dotAvx2;
+            simd.axpy = axpyAvx2;
+            simd.add = addAvx2;
+            simd.mul = mulAvx2;
+            simd.set = setAvx2;
+            simd.dotF = dotFAvx2;
+            simd.axpyF = axpyFAvx2;
+            simd.addF = addFAvx2;
+            simd.mulF = mulFAvx2;
+            simd.setF = setFAvx2;
+            break;
+        case SIMD_SSE2:
+            simd.dot = dotSse2;
+            simd.axpy = axpySse2;
+            simd.add = addSse2;
+            simd.mul = mulSse2;
+            simd.set = setSse2;
+            simd.dotF = dotFSse2;
+            simd.axpyF = axpyFSse2;
+            simd.addF = addFSse2;
+            simd.mulF = mulFSse2;
+            simd.setF = setFSse2;
+            break;
+    }
+#endif
+}
@@ -0,0 +1,209 @@
+/**
+ * Thread pool file holding the persistent worker threads that the Matrix functions split their work across.
+ *
+ * Workers are started lazily on the first parallel dispatch and then sleep on a condition variable between jobs,
+ * so a dispatch only costs a broadcast and a wait. Every job is cut into at most one contiguous part per thread.
+ *
+ * Author: Fabio Hux
+ *
+ * Date Created: October 2026
+ *
+ * Date Last Edited: 10/17/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "libremodel.h"
+#include "components/thread_pool.h"
+
+#define THREAD_POOL_DEFAULT_THRESHOLD (1L << 18)
+
+//Dispatch lock. Held by whichever thread is currently driving the pool.
+static pthread_mutex_t pool_dispatch = PTHREAD_MUTEX_INITIALIZER;
+
+//Job hand-off between the dispatcher and the workers
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+
+static pthread_t *pool_threads = NULL;
+static int pool_size = 0;   /*Threads including the caller, 0 means "not decided yet"*/
+static int pool_started = 0;    /*Number of worker threads currently running*/
+static char pool_shutdown = 0;
+static long pool_threshold = THREAD_POOL_DEFAULT_THRESHOLD;
+
+static unsigned int pool_generation = 0;
+static void (*pool_task)(void *, int, int) = NULL;
+static void *pool_arg = NULL;
+static int pool_total = 0, pool_parts = 0;
+static atomic_ullong pool_next;  /*(generation << 32) | next part. Stale workers can't claim parts of a newer job.*/
+static atomic_int pool_pending;
+
+static __thread char pool_in_task = 0;
+
+static void threadPoolRunPart(void (*task)(void *, int, int), void *arg, int total, int parts, int part){
+    const int start = (int) (((long) total * part) / parts);
+    const int end = (int) (((long) total * (part + 1)) / parts);
+
+    pool_in_task = 1;
+    task(arg, start, end);
+    pool_in_task = 0;
+}
+
+/**
+ * Claims and runs parts of the job tagged with generation until none are left.
+ **/
+static void threadPoolDrain(unsigned int generation, void (*task)(void *, int, int), void *arg, int total, int parts){
+    unsigned long long next = atomic_load(&pool_next);
+
+    while((unsigned int) (next >> 32) == generation && (int) (next & 0xffffffffu) < parts){
+        if(atomic_compare_exchange_weak(&pool_next, &next, next + 1)){
+            threadPoolRunPart(task, arg, total, parts, (int) (next & 0xffffffffu));
+
+            if(atomic_fetch_sub(&pool_pending, 1) == 1){
+                pthread_mutex_lock(&pool_mutex);
+                pthread_cond_signal(&pool_done);
+                pthread_mutex_unlock(&pool_mutex);
+            }
+            next = atomic_load(&pool_next);
+        }
+    }
+}
+
+static void *threadPoolWorker(void *unused){
+    (void) unused;
+    unsigned int seen = 0;
+
+    pthread_mutex_lock(&pool_mutex);
+    seen = pool_generation;
+
+    for(;;){
+        while(seen == pool_generation && !pool_shutdown){
+            pthread_cond_wait(&pool_wake, &pool_mutex);
+        }
+        if(pool_shutdown) break;
+
+        //Snapshot the job while holding the lock
+        seen = pool_generation;
+        void (*task)(void *, int, int) = pool_task;
+        void *arg = pool_arg;
+        const int total = pool_total, parts = pool_parts;
+        pthread_mutex_unlock(&pool_mutex);
+
+        threadPoolDrain(seen, task, arg, total, parts);
+
+        pthread_mutex_lock(&pool_mutex);
+    }
+
+    pthread_mutex_unlock(&pool_mutex);
+    return NULL;
+}
+
+static int threadPoolDefaultSize(void){
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int) cores : 1;
+}
+
+static void threadPoolStart(void){
+    if(pool_size == 0) pool_size = threadPoolDefaultSize();
+    if(pool_started == pool_size - 1) return;
+
+    pool_threads = (pthread_t *) calloc(pool_size, sizeof(pthread_t));
+    if(pool_threads == NULL){
+        printf("Error making thread pool. Insufficient space. Exiting.\n");
+        exit(0);
+    }
+
+    pool_shutdown = 0;
+    for(pool_started = 0; pool_started < pool_size - 1; pool_started++){
+        if(pthread_create(pool_threads + pool_started, NULL, threadPoolWorker, NULL)){
+            fprintf(stderr, "Unable to start thread pool worker. Continuing with %d threads.\n", pool_started + 1);
+            pool_size = pool_started + 1;
+            break;
+        }
+    }
+}
+
+static void threadPoolStop(void){
+    int i;
+
+    pthread_mutex_lock(&pool_mutex);
+    pool_shutdown = 1;
+    pthread_cond_broadcast(&pool_wake);
+    pthread_mutex_unlock(&pool_mutex);
+
+    for(i = 0; i < pool_started; i++){
+        pthread_join(pool_threads[i], NULL);
+    }
+
+    free(pool_threads);
+    pool_threads = NULL;
+    pool_started = 0;
+    pool_shutdown = 0;
+}
+
+void threadPoolRun(void (*task)(void *, int, int), void *arg, int total){
+    if(task == NULL || total <= 0) return;
+
+    if(total == 1 || pool_in_task || pool_size == 1 || pthread_mutex_trylock(&pool_dispatch)){
+        task(arg, 0, total);
+        return;
+    }
+
+    threadPoolStart();
+
+    const int parts = total < pool_size ? total : pool_size;
+    if(parts <= 1){
+        pthread_mutex_unlock(&pool_dispatch);
+        task(arg, 0, total);
+        return;
+    }
+
+    pthread_mutex_lock(&pool_mutex);
+    const unsigned int generation = ++pool_generation;
+    pool_task = task;
+    pool_arg = arg;
+    pool_total = total;
+    pool_parts = parts;
+    atomic_store(&pool_pending, parts);
+    atomic_store(&pool_next, (unsigned long long) generation << 32);
+    pthread_cond_broadcast(&pool_wake);
+    pthread_mutex_unlock(&pool_mutex);
+
+    //The caller works too instead of just waiting
+    threadPoolDrain(generation, task, arg, total, parts);
+
+    pthread_mutex_lock(&pool_mutex);
+    while(atomic_load(&pool_pending) > 0){
+        pthread_cond_wait(&pool_done, &pool_mutex);
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    pthread_mutex_unlock(&pool_dispatch);
+}
+
+char threadPoolWorthIt(double work){
+    return pool_size != 1 && !pool_in_task && work >= pool_threshold;
+}
+
+void threadPoolSetSize(int threads){
+    if(threads < 1) threads = threadPoolDefaultSize();
+
+    pthread_mutex_lock(&pool_dispatch);
+    if(threads != pool_size){
+        if(pool_started) threadPoolStop();
+        pool_size = threads;
+    }
+    pthread_mutex_unlock(&pool_dispatch);
+}
+
+int threadPoolGetSize(){
+    if(pool_size == 0) return threadPoolDefaultSize();
+    return pool_size;
+}
+
+void matrixSetParallelThreshold(long work){
+    pool_threshold = work < 0 ? THREAD_POOL_DEFAULT_THRESHOLD : work;
+}
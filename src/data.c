@@ -62,6 +62,7 @@ void deleteData(Data *data){
     listDestroy(data->feats);
     listDestroy(data->cls);
     listDestroy(data->uFeats);
+    matrixDestroy(data->featMat, 0);
 
     free(data);
 }
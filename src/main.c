@@ -7,6 +7,13 @@
 
 #define N 10
 
+//Elapsed seconds (clock() counts CPU time, summed over every thread of the pool)
+double wallTime(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
 int sorter(void *a, void *b){
     return strcmp(*((char **)a), *((char **)b));
 }
@@ -145,21 +152,23 @@ int main(){
     //networkTest();
     //matrixTest();
     //return 0;
-    clock_t secs;    
-    secs = clock();
+    double secs;    
+    secs = wallTime();
     printf("Hi");
     
    // matrixTest();
 //     testing();
 
       Data *data = extractData("training.txt");
-      binTransform(data, .025, .03);
+      binTransform(data, .025, .03, MATRIX_FLOAT32);
      
      printf("***SIZE AFTER TRANSFORM: %d***\n", listGetSize(data->uFeats));
-    printf("\nTime to complete stage 1: %lf\n", (double)(clock()-secs) / CLOCKS_PER_SEC);
+    printf("\nTime to complete stage 1: %lf\n", wallTime() - secs);
      //printList(data->uFeats);
     NeuralNetworkSolver *solver = neural_network_solver_sgd(.05, 1);
+    neural_network_solver_set_type(solver, MATRIX_FLOAT32);
      NeuralNetwork *network = neural_network_create(solver, 1, "output2.json", 4435621);
+     neural_network_set_batch_size(network, 32);
      
      int layers[] = {100, 75, 50, 25};
      neural_network_add_input_layer(network, matrixGetN(LIST_DER(Matrix *, listGet(data->feats, 0))));
@@ -169,7 +178,9 @@ int main(){
      }
      neural_network_add_output_layer(network, matrixGetN(LIST_DER(Matrix *, listGet(data->cls, 0))));
     
+     neural_network_set_profiling(network, 1);
      neural_network_train(network, data->feats, data->cls);
+     neural_network_print_profile(network, stdout);
      
 //     const int numCV = 8;
 //     List *crossVals = createCrossVal(data, numCV);
@@ -193,7 +204,7 @@ int main(){
 //     listDestroy(crossVals);
 //     deleteData(data);
 
-    printf("\nTime to complete everything: %lf\n", (double)(clock()-secs) / CLOCKS_PER_SEC);
+    printf("\nTime to complete everything: %lf\n", wallTime() - secs);
 
     return 0;
 }
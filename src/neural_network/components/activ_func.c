@@ -6,101 +6,38 @@
 void sigmoid(Matrix *input, Matrix *output){
     if(input == NULL || output == NULL) return;
     
-    matrixResetIter(input);
-    if(input != output){
-        matrixResetIter(output);
-    }
-    double value;
-    
-    while(!isnan(value = matrixGetNext(input, -1))){
-        if(input != output){
-            matrixGetNext(output, -1);
-        }
-        
-        value = 1.0 / (1.0 + exp(-value));
-        if(isnan(value)){
-            printf("bad nums\n");
-            value = 0;
-        }
-        matrixSetPrevious(output, value);
-    }
+    matrixMap(input, output, MATRIX_MAP_SIGMOID);
 }
 
-Matrix *der_sigmoid(Matrix *z, Matrix *a){
-    if(z == NULL && a == NULL) return NULL;
-    
-    Matrix *vector = z;
-    
-    if(a != NULL) vector = a;
-    
-    Matrix *c = matrixCreate(matrixGetN(vector), matrixGetN(vector), NULL, matrixGetN(vector) * matrixGetN(vector));
-    if(c == NULL) return NULL;
-    
-    double value, temp;
-    int i = 0;
-    
-    matrixResetIter(vector);
-    
-    while(!isnan(value = matrixGetNext(vector, -1))){
-//         expval = exp(value);
-//         temp = expval + 1;
-//         temp *= temp;
-//         matrixSetValue(c, i, i, expval / temp);
-        if(a == NULL) temp = 1.0 / (1.0 + exp(-value));
-        else temp = value;
-        matrixSetValue(c, i, i, temp * (1 - temp));
-        i++;
+/**
+ * Derivative functions compute dz = da (Hadamard) f'(z) directly, since the Jacobian of an elementwise activation is diagonal.
+ * Each is a single MATRIX_ZIP_* kernel; a new activation only needs its own zip op.
+ **/
+void der_sigmoid(Matrix *z, Matrix *a, Matrix *da, Matrix *dz){
+    if((z == NULL && a == NULL) || da == NULL || dz == NULL) return;
+    
+    //The derivative is a * (1 - a), so recompute a from z (into dz) only if it wasn't given
+    if(a == NULL){
+        matrixMap(z, dz, MATRIX_MAP_SIGMOID);
+        a = dz;
     }
-    return c;
+    matrixZip(da, a, dz, MATRIX_ZIP_DER_SIGMOID);
 }
 
 void relu(Matrix *input, Matrix *output){
     if(input == NULL || output == NULL) return;
     
-    matrixResetIter(input);
-    if(input != output){
-        matrixResetIter(output);
-    }
-    double value;
-    
-    while(!isnan(value = matrixGetNext(input, -1))){
-        if(input != output){
-            matrixGetNext(output, -1);
-        }
-        
-        value = (value < 0) ? 0 : value;
-        if(isnan(value)){
-            printf("bad nums\n");
-            value = 0;
-        }
-        matrixSetPrevious(output, value);
-    }
+    matrixMap(input, output, MATRIX_MAP_RELU);
 }
 
-Matrix *der_relu(Matrix *z, Matrix *a){
-    if(z == NULL) return NULL;
+void der_relu(Matrix *z, Matrix *a, Matrix *da, Matrix *dz){
+    if(z == NULL || da == NULL || dz == NULL) return;
     (void) a;
     
-    Matrix *c = matrixCreate(matrixGetN(z), matrixGetN(z), NULL, matrixGetN(z) * matrixGetN(z));
-    if(c == NULL) return NULL;
-    
-    double value;
-    int i = 0;
-    
-    matrixResetIter(z);
-    
-    while(!isnan(value = matrixGetNext(z, -1))){
-//         expval = exp(value);
-//         temp = expval + 1;
-//         temp *= temp;
-//         matrixSetValue(c, i, i, expval / temp);
-        matrixSetValue(c, i, i, (value < 0) ? 0 : 1);
-        i++;
-    }
-    return c;
+    matrixZip(da, z, dz, MATRIX_ZIP_DER_RELU);
 }
 
-void activ_fun_set_fun(void (**activation_function)(Matrix *, Matrix *), Matrix *(**d_activation_function)(Matrix *, Matrix *), int flag){
+void activ_fun_set_fun(void (**activation_function)(Matrix *, Matrix *), void (**d_activation_function)(Matrix *, Matrix *, Matrix *, Matrix *), int flag){
     if(flag < 0 || activation_function == NULL || d_activation_function == NULL) return;
     
     switch(flag){
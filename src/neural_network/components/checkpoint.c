@@ -0,0 +1,328 @@
+/**
+ * Checkpoint file holding the training snapshots neural_network_train() leaves behind, and the thread writing them.
+ *
+ * A checkpoint file is a header followed by the parameter arena, the optimizer moments and best parameters it holds
+ * (each as matrixWriteRaw() lays it out) and the sample order. Files are written next to their target and renamed over
+ * it, so the file on disk is always a whole checkpoint, the latest one finished.
+ *
+ * Author: Fabio Hux
+ *
+ * Date Created: October 2026
+ *
+ * Date Last Edited: 10/17/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "libremodel.h"
+#include "neural_network/components/checkpoint.h"
+
+#define CHECKPOINT_MAGIC "NNCCHKPT"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_BYTE_ORDER 0x01020304u
+
+//Optional blocks following the parameters
+#define CHECKPOINT_HAS_MEAN 1
+#define CHECKPOINT_HAS_SQUARE 2
+#define CHECKPOINT_HAS_BEST 4
+
+typedef struct{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t params_type;   /*Element type of params and best*/
+    uint32_t moments_type;  /*Element type of the moments*/
+    uint32_t flags;         /*CHECKPOINT_HAS_* blocks in the file*/
+    uint32_t shuffle;
+    int32_t samples, epoch, position, stale;
+    int64_t steps;
+    uint64_t params_size;   /*Elements of params, the moments and best alike*/
+    double best_loss;
+} CheckpointHeader;
+
+void checkpoint_clear(NeuralCheckpoint *checkpoint){
+    if(checkpoint == NULL) return;
+
+    matrixDestroy(checkpoint->params, 0);
+    matrixDestroy(checkpoint->moments[0], 0);
+    matrixDestroy(checkpoint->moments[1], 0);
+    matrixDestroy(checkpoint->best, 0);
+    free(checkpoint->order);
+    memset(checkpoint, 0, sizeof(NeuralCheckpoint));
+}
+
+/**
+ * Flushes the directory holding filename, so a rename into it survives a power loss.
+ **/
+static char checkpoint_sync_directory(char *filename){
+    const char *slash = strrchr(filename, '/');
+    char *directory = slash == NULL ? strdup(".") : strndup(filename, slash == filename ? 1 : slash - filename);
+    char ret = 0;
+
+    if(directory == NULL){
+        printf("Error writing checkpoint. Insufficient space. Exiting.\n");
+        exit(0);
+    }
+
+    const int fd = open(directory, O_RDONLY | O_DIRECTORY);
+    if(fd >= 0){
+        ret = !fsync(fd);
+        close(fd);
+    }
+
+    free(directory);
+    return ret;
+}
+
+char checkpoint_write(NeuralCheckpoint *checkpoint, char *filename){
+    if(checkpoint == NULL || filename == NULL || checkpoint->params == NULL || checkpoint->order == NULL) return 0;
+
+    CheckpointHeader header = {.magic = CHECKPOINT_MAGIC, .version = CHECKPOINT_VERSION, .byte_order = CHECKPOINT_BYTE_ORDER};
+    char *temp = (char *) malloc(strlen(filename) + 5);
+    char ret = 0;
+    int i;
+
+    if(temp == NULL){
+        printf("Error writing checkpoint. Insufficient space. Exiting.\n");
+        exit(0);
+    }
+    sprintf(temp, "%s.tmp", filename);
+
+    header.params_type = (uint32_t) matrixGetType(checkpoint->params);
+    header.moments_type = checkpoint->moments[0] != NULL ? (uint32_t) matrixGetType(checkpoint->moments[0])
+        : checkpoint->moments[1] != NULL ? (uint32_t) matrixGetType(checkpoint->moments[1]) : header.params_type;
+    header.flags = (checkpoint->moments[0] != NULL ? CHECKPOINT_HAS_MEAN : 0) | (checkpoint->moments[1] != NULL ? CHECKPOINT_HAS_SQUARE : 0) | (checkpoint->best != NULL ? CHECKPOINT_HAS_BEST : 0);
+    header.shuffle = checkpoint->shuffle;
+    header.samples = checkpoint->samples;
+    header.epoch = checkpoint->epoch;
+    header.position = checkpoint->position;
+    header.stale = checkpoint->stale;
+    header.steps = checkpoint->steps;
+    header.params_size = matrixGetM(checkpoint->params);
+    header.best_loss = checkpoint->best_loss;
+
+    FILE *file = fopen(temp, "wb");
+    if(file != NULL){
+        ret = fwrite(&header, sizeof(header), 1, file) == 1 && matrixWriteRaw(checkpoint->params, file) >= 0;
+        for(i = 0; i < 2; i++){
+            if(ret && checkpoint->moments[i] != NULL) ret = matrixWriteRaw(checkpoint->moments[i], file) >= 0;
+        }
+        if(ret && checkpoint->best != NULL) ret = matrixWriteRaw(checkpoint->best, file) >= 0;
+        ret = ret && fwrite(checkpoint->order, sizeof(int), checkpoint->samples, file) == (size_t) checkpoint->samples;
+
+        //On disk before the rename makes it the checkpoint, so a crash leaves the old one rather than a torn one
+        ret = ret && !fflush(file) && !fsync(fileno(file));
+        if(fclose(file)) ret = 0;
+    }
+
+    if(ret && rename(temp, filename)) ret = 0;
+    ret = ret && checkpoint_sync_directory(filename);
+    if(!ret){
+        fprintf(stderr, "Error writing checkpoint %s.\n", filename);
+        remove(temp);
+    }
+
+    free(temp);
+    return ret;
+}
+
+/**
+ * A 1 x size arena of the given type read from file, or NULL.
+ **/
+static Matrix *checkpoint_read_arena(FILE *file, long size, char type){
+    Matrix *ret = type == MATRIX_FLOAT32 ? matrixCreateF(1, (int) size, NULL, (int) size) : matrixCreate(1, (int) size, NULL, (int) size);
+
+    if(ret != NULL && matrixReadRaw(ret, file) < 0){
+        matrixDestroy(ret, 0);
+        ret = NULL;
+    }
+
+    return ret;
+}
+
+char checkpoint_read(NeuralCheckpoint *checkpoint, char *filename){
+    if(checkpoint == NULL || filename == NULL) return 0;
+
+    CheckpointHeader header;
+    FILE *file = fopen(filename, "rb");
+    char ret;
+
+    if(file == NULL){
+        fprintf(stderr, "Error reading checkpoint. Can't open %s.\n", filename);
+        return 0;
+    }
+
+    ret = fread(&header, sizeof(header), 1, file) == 1
+        && !memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic))
+        && header.version == CHECKPOINT_VERSION
+        && header.byte_order == CHECKPOINT_BYTE_ORDER
+        && (header.params_type == MATRIX_FLOAT64 || header.params_type == MATRIX_FLOAT32)
+        && (header.moments_type == MATRIX_FLOAT64 || header.moments_type == MATRIX_FLOAT32)
+        && header.params_size > 0 && header.params_size <= INT32_MAX
+        && header.samples > 0 && header.epoch >= 0 && header.position >= 0 && header.position < header.samples && header.steps >= 0;
+
+    if(ret){
+        checkpoint->params = checkpoint_read_arena(file, (long) header.params_size, (char) header.params_type);
+        ret = checkpoint->params != NULL;
+    }
+    if(ret && (header.flags & CHECKPOINT_HAS_MEAN)){
+        checkpoint->moments[0] = checkpoint_read_arena(file, (long) header.params_size, (char) header.moments_type);
+        ret = checkpoint->moments[0] != NULL;
+    }
+    if(ret && (header.flags & CHECKPOINT_HAS_SQUARE)){
+        checkpoint->moments[1] = checkpoint_read_arena(file, (long) header.params_size, (char) header.moments_type);
+        ret = checkpoint->moments[1] != NULL;
+    }
+    if(ret && (header.flags & CHECKPOINT_HAS_BEST)){
+        checkpoint->best = checkpoint_read_arena(file, (long) header.params_size, (char) header.params_type);
+        ret = checkpoint->best != NULL;
+    }
+    if(ret){
+        checkpoint->order = (int *) malloc(header.samples * sizeof(int));
+        ret = checkpoint->order != NULL && fread(checkpoint->order, sizeof(int), header.samples, file) == (size_t) header.samples;
+    }
+    fclose(file);
+
+    if(!ret){
+        fprintf(stderr, "Error reading checkpoint. %s isn't a valid checkpoint file.\n", filename);
+        checkpoint_clear(checkpoint);
+        return 0;
+    }
+
+    checkpoint->shuffle = header.shuffle;
+    checkpoint->samples = header.samples;
+    checkpoint->epoch = header.epoch;
+    checkpoint->position = header.position;
+    checkpoint->stale = header.stale;
+    checkpoint->steps = header.steps;
+    checkpoint->best_loss = header.best_loss;
+
+    return 1;
+}
+
+
+/**
+ * Background writer
+ **/
+
+//What a writer's snapshot is in the middle of
+#define CHECKPOINT_FREE 0
+#define CHECKPOINT_FILLING 1
+#define CHECKPOINT_READY 2
+#define CHECKPOINT_WRITING 3
+
+struct _neural_checkpoint_writer{
+    NeuralCheckpoint snapshots[2];
+    char state[2];          /*CHECKPOINT_* state of each snapshot*/
+    long submitted[2];      /*When each snapshot was submitted, to write the latest one*/
+    long submits;
+    int filling;            /*Snapshot handed out by checkpoint_writer_acquire()*/
+    char *filename;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    char stop;
+};
+
+static void *checkpoint_writer_run(void *arg){
+    NeuralCheckpointWriter *writer = (NeuralCheckpointWriter *) arg;
+    int i;
+
+    pthread_mutex_lock(&writer->lock);
+    while(1){
+        //The latest snapshot submitted goes, and an older one still waiting is dropped for it
+        i = writer->state[1] == CHECKPOINT_READY && (writer->state[0] != CHECKPOINT_READY || writer->submitted[1] > writer->submitted[0]);
+        if(writer->state[i] != CHECKPOINT_READY){
+            if(writer->stop) break;
+            pthread_cond_wait(&writer->wake, &writer->lock);
+            continue;
+        }
+        if(writer->state[!i] == CHECKPOINT_READY) writer->state[!i] = CHECKPOINT_FREE;
+
+        writer->state[i] = CHECKPOINT_WRITING;
+        pthread_mutex_unlock(&writer->lock);
+        checkpoint_write(&writer->snapshots[i], writer->filename);
+        pthread_mutex_lock(&writer->lock);
+        writer->state[i] = CHECKPOINT_FREE;
+    }
+    pthread_mutex_unlock(&writer->lock);
+
+    return NULL;
+}
+
+NeuralCheckpointWriter *checkpoint_writer_create(char *filename){
+    if(filename == NULL) return NULL;
+
+    NeuralCheckpointWriter *ret = (NeuralCheckpointWriter *) calloc(1, sizeof(NeuralCheckpointWriter));
+    if(ret == NULL || (ret->filename = strdup(filename)) == NULL){
+        printf("Error making checkpoint writer. Insufficient space. Exiting.\n");
+        exit(0);
+    }
+
+    ret->filling = -1;
+    pthread_mutex_init(&ret->lock, NULL);
+    pthread_cond_init(&ret->wake, NULL);
+    if(pthread_create(&ret->thread, NULL, checkpoint_writer_run, ret)){
+        fprintf(stderr, "Error making checkpoint writer. Can't start its thread.\n");
+        pthread_mutex_destroy(&ret->lock);
+        pthread_cond_destroy(&ret->wake);
+        free(ret->filename);
+        free(ret);
+        return NULL;
+    }
+
+    return ret;
+}
+
+NeuralCheckpoint *checkpoint_writer_acquire(NeuralCheckpointWriter *writer){
+    if(writer == NULL || writer->filling >= 0) return NULL;
+
+    int i;
+
+    //At most one snapshot is being written, and a free one beats overwriting one that is waiting
+    pthread_mutex_lock(&writer->lock);
+    if(writer->state[0] == CHECKPOINT_WRITING) i = 1;
+    else if(writer->state[1] == CHECKPOINT_WRITING) i = 0;
+    else if(writer->state[0] == CHECKPOINT_FREE) i = 0;
+    else if(writer->state[1] == CHECKPOINT_FREE) i = 1;
+    else i = writer->submitted[0] > writer->submitted[1];
+    writer->state[i] = CHECKPOINT_FILLING;
+    writer->filling = i;
+    pthread_mutex_unlock(&writer->lock);
+
+    return &writer->snapshots[i];
+}
+
+void checkpoint_writer_submit(NeuralCheckpointWriter *writer){
+    if(writer == NULL || writer->filling < 0) return;
+
+    pthread_mutex_lock(&writer->lock);
+    writer->state[writer->filling] = CHECKPOINT_READY;
+    writer->submitted[writer->filling] = ++writer->submits;
+    writer->filling = -1;
+    pthread_cond_signal(&writer->wake);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void checkpoint_writer_destroy(NeuralCheckpointWriter *writer){
+    if(writer == NULL) return;
+
+    //A snapshot acquired but never submitted isn't whole, so it isn't written
+    pthread_mutex_lock(&writer->lock);
+    if(writer->filling >= 0) writer->state[writer->filling] = CHECKPOINT_FREE;
+    writer->stop = 1;
+    pthread_cond_signal(&writer->wake);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    checkpoint_clear(&writer->snapshots[0]);
+    checkpoint_clear(&writer->snapshots[1]);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->wake);
+    free(writer->filename);
+    free(writer);
+}
@@ -1,12 +1,24 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
+#include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "libremodel.h"
 #include "neural_network/neural.h"
 #include "neural_network/components/solver.h"
 #include "neural_network/components/activ_func.h"
 
 
+//Optimizer state kept by a solver
+#define SOLVER_STATE_MEAN 1
+#define SOLVER_STATE_SQUARE 2
+
 struct _neural_network_hidden_solver{
     NeuralNetwork *network;
     List *layers;
@@ -15,10 +27,36 @@ struct _neural_network_hidden_solver{
     void (*step_forward)(void *, Matrix **);
     void (*dz_solver)(void *);
     void (*da_solver)(void *, void *);
-    void (*dw_db_solver)(void *, void *, double);
+    void (*dw_db_solver)(NeuralNetworkHiddenSolver *, void *, void *, int);
     void (*d_cost)(void *, Matrix *);
+    void (*set_columns)(void *, int, int);
+    void (*update)(NeuralNetworkHiddenSolver *, Matrix *);  /*Applies an averaged gradient arena to every parameter (NULL if dw_db_solver already did)*/
+    Matrix *params, *grads;     /*1 x N arenas holding every layer's w and b, and dw and db at the same offsets*/
+    Matrix *moments[2];         /*Optimizer state laid out like params: the gradient's running mean and mean square (NULL if unused)*/
+    Matrix *weights;    /*float64 master copy of params that mixed precision updates, params being its float32 shadow (NULL otherwise)*/
+    NeuralNetworkHiddenSolver *master;  /*Solver whose params and moments a replica shares (NULL if these are its own)*/
+    char replica;   /*SOLVER_REPLICA_* mode of a replica*/
+    Matrix *sparse_w, *sparse_x;    /*Views of a first layer column and an input row (shared SGD replicas only, NULL until used)*/
+    int *sparse_rows;               /*Inputs a batch has, one per first layer column (shared SGD replicas only, NULL until used)*/
+    Allreduce *comm;    /*Other processes training the same network (NULL if alone, and always in replicas)*/
+    void (*local_dw_db_solver)(NeuralNetworkHiddenSolver *, void *, void *, int);  /*dw_db_solver while comm averages the gradients*/
+    int comm_period;    /*Updates between parameter averages*/
+    char comm_mode;     /*NEURAL_ALLREDUCE_* data comm averages*/
+    NeuralProfile (*profile)[NEURAL_PROFILE_KERNELS];   /*Counters of every layer's kernels, row 0 for the whole network (NULL when not profiling)*/
+    int profile_rows;
     int input_size;
+    int batch_size; /*Columns allocated for each layer's activations and their gradients*/
+    int columns;    /*Columns (samples) of the batch currently going through the layers*/
     double alpha, rate;
+    double beta;    /*Second moment decay (Adam only)*/
+    long steps;     /*Weight updates done so far*/
+    unsigned long seed; /*Weight initialization seed, each layer drawing from its own stream*/
+    char state;     /*SOLVER_STATE_* moments the solver keeps*/
+    char type;  /*Element type (MATRIX_FLOAT64/MATRIX_FLOAT32) of every layer matrix*/
+    char mixed; /*Float32 layers updated through float64 master weights and moments*/
+    char frozen;    /*Inference only: the layers hold nothing but w and b, and there's nothing to train with*/
+    void *mapping;  /*Model file params is a view of (NULL unless loaded with solver_load())*/
+    size_t mapping_size;
 };
 
 void neural_network_set_solver(NeuralNetworkSolver *solver, NeuralNetwork *network){
@@ -28,11 +66,74 @@ void neural_network_set_solver(NeuralNetworkSolver *solver, NeuralNetwork *netwo
     }
 }
 
+void neural_network_solver_set_type(NeuralNetworkSolver *solver, char type){
+    if(!solver_check_valid(solver) || (type != MATRIX_FLOAT64 && type != MATRIX_FLOAT32)) return;
+    
+    //Layers already built keep their type, so this only makes sense before the input layer is added
+    if(solver->hidden_solver->layers != NULL){
+        printf("Solver type must be set before adding layers. Ignoring.\n");
+        return;
+    }
+    
+    solver->hidden_solver->type = type;
+    solver->hidden_solver->mixed = 0;
+}
+
+void sgd_update(NeuralNetworkHiddenSolver *h_solver, Matrix *grads);
+void moment_dw_db_solver(NeuralNetworkHiddenSolver *h_solver, void *fl, void *bl, int columns);
+void sgd_dw_dz_solver(NeuralNetworkHiddenSolver *h_solver, void *fl, void *bl, int columns);
+void sgd_sparse_dw_db_solver(NeuralNetworkHiddenSolver *h_solver, void *fl, void *bl, int columns);
+
+void neural_network_solver_set_mixed_precision(NeuralNetworkSolver *solver){
+    if(!solver_check_valid(solver)) return;
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    
+    if(h_solver->layers != NULL){
+        printf("Solver type must be set before adding layers. Ignoring.\n");
+        return;
+    }
+    
+    h_solver->type = MATRIX_FLOAT32;
+    h_solver->mixed = 1;
+    
+    //SGD writes straight into the float w, so it leaves its gradient behind for a double update like the other solvers
+    if(h_solver->update == NULL){
+        h_solver->dw_db_solver = moment_dw_db_solver;
+        h_solver->update = sgd_update;
+    }
+}
+
+void solver_set_seed(NeuralNetworkSolver *solver, unsigned long seed){
+    if(!solver_check_valid(solver)) return;
+    
+    solver->hidden_solver->seed = seed;
+}
+
+char solver_is_frozen(NeuralNetworkSolver *solver){
+    return solver_check_valid(solver) && solver->hidden_solver->frozen;
+}
+
+void solver_set_batch_size(NeuralNetworkSolver *solver, int batch_size){
+    if(!solver_check_valid(solver) || batch_size < 1 || solver->hidden_solver->frozen) return;
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    int i;
+    
+    h_solver->batch_size = batch_size;
+    h_solver->columns = batch_size;
+    for(i = 0; h_solver->layers != NULL && i < listGetSize(h_solver->layers); i++){
+        h_solver->set_columns(*((void **) listGet(h_solver->layers, i)), batch_size, batch_size);
+    }
+}
+
 char hidden_solver_check_valid(NeuralNetworkHiddenSolver *solver){
     return solver != NULL 
         && solver->network != NULL; //Should have the same network. Would be bad otherwise.
 }
 
+static Matrix *generic_layer_weights(void *target);
+
 int solver_get_num_layers(NeuralNetworkSolver *solver){
     if(!solver_check_valid(solver) || !hidden_solver_check_valid(solver->hidden_solver)) return -1;
     
@@ -44,77 +145,399 @@ int solver_get_layer_n_val(NeuralNetworkSolver *solver, int layer_number){
     
     if(layer_number == 0) return solver->hidden_solver->input_size;
     
-    return matrixGetN(*(LIST_DER(Matrix **, listGet(solver->hidden_solver->layers, layer_number - 1))));
+    //w has a row per node, and unlike a it is still there once the layer is frozen
+    return matrixGetN(generic_layer_weights(LIST_DER(void *, listGet(solver->hidden_solver->layers, layer_number - 1))));
 }
 
-int solver_get_layer_m_val(NeuralNetworkSolver *solver, int layer_number){
-    if(!solver_check_valid(solver) || !hidden_solver_check_valid(solver->hidden_solver)) return -1;
+Matrix *solver_get_output_layer(NeuralNetworkSolver *solver){
+    if(!solver_check_valid(solver) || !hidden_solver_check_valid(solver->hidden_solver) || !listGetSize(solver->hidden_solver->layers)) return NULL;
     
-    if(layer_number == 0) return solver->hidden_solver->input_size;
+    //Frozen layers keep no activations, their outputs only ever land in an inference context's buffers
+    if(solver->hidden_solver->frozen) return NULL;
     
-    return matrixGetM(*(LIST_DER(Matrix **, listGet(solver->hidden_solver->layers, layer_number - 1))));
+    return *(LIST_DER(Matrix **, listGet(solver->hidden_solver->layers, listGetSize(solver->hidden_solver->layers) - 1)));
 }
 
-Matrix *solver_get_output_layer(NeuralNetworkSolver *solver){
-    if(!solver_check_valid(solver) || !hidden_solver_check_valid(solver->hidden_solver) || !listGetSize(solver->hidden_solver->layers)) return NULL;
+/**
+ * Profiling
+ *
+ * While a profile is kept, every layer callback is timed and charged the floating point operations and bytes it needs
+ * (counting each operand once). Nothing is measured otherwise, so it only costs a NULL check per callback.
+ **/
+
+static void generic_layer_cost(void *target, int kernel, int columns, char type, double *flops, double *bytes);
+
+static double solver_clock(){
+    struct timespec now;
     
-    return *(LIST_DER(Matrix **, listGet(solver->hidden_solver->layers, listGetSize(solver->hidden_solver->layers) - 1)));
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
 }
 
-void neural_network_forward_propagate(NeuralNetworkSolver *solver, Matrix *input){
-    if(input == NULL || !solver_check_valid(solver)) return;
+/**
+ * Charges a call of kernel that started at start (a solver_clock() time) to row of the profile.
+ **/
+static void solver_profile_add(NeuralNetworkHiddenSolver *h_solver, int row, int kernel, double start, double flops, double bytes){
+    if(row >= h_solver->profile_rows) return;
+    
+    NeuralProfile *entry = &h_solver->profile[row][kernel];
+    
+    entry->seconds += solver_clock() - start;
+    entry->flops += flops;
+    entry->bytes += bytes;
+    entry->calls++;
+}
+
+static void solver_profile_layer(NeuralNetworkHiddenSolver *h_solver, int i, int kernel, double start){
+    double flops, bytes;
+    
+    generic_layer_cost(*((void **) listGet(h_solver->layers, i)), kernel, h_solver->columns, h_solver->type, &flops, &bytes);
+    solver_profile_add(h_solver, i + 1, kernel, start, flops, bytes);
+}
+
+/**
+ * The optimizer's sweep over all P parameters: w += rate * g for SGD (after scaling g), otherwise the fused moment update
+ * after scaling g. sqrt and divisions count as one operation each.
+ **/
+static void solver_profile_update(NeuralNetworkHiddenSolver *h_solver, double start){
+    const double params = matrixGetM(h_solver->params);
+    const double size = h_solver->type == MATRIX_FLOAT32 ? sizeof(float) : sizeof(double);
+    const double master = h_solver->weights != NULL ? sizeof(double) : size;
+    const int moments = (h_solver->state & SOLVER_STATE_MEAN ? 1 : 0) + (h_solver->state & SOLVER_STATE_SQUARE ? 1 : 0);
+    const double flops = h_solver->state == 0 ? 2 : h_solver->state == SOLVER_STATE_MEAN ? 5 : h_solver->state == SOLVER_STATE_SQUARE ? 9 : 14;
+    
+    //g is scaled (read and written) then read again, w and the moments are read and written, and so is the shadow of mixed precision
+    const double bytes = 3 * size + (2 + 2 * moments) * master + (h_solver->weights != NULL ? size : 0);
+    
+    solver_profile_add(h_solver, 0, NEURAL_PROFILE_UPDATE, start, flops * params, bytes * params);
+}
+
+//Runs CALL, the KERNEL callback of layer LAYER, timing it when the solver is profiled
+#define SOLVER_PROFILED(H_SOLVER, LAYER, KERNEL, CALL) do{ \
+    if((H_SOLVER)->profile == NULL){ \
+        CALL; \
+        break; \
+    } \
+    const double profile_start = solver_clock(); \
+    CALL; \
+    solver_profile_layer(H_SOLVER, LAYER, KERNEL, profile_start); \
+}while(0)
+
+void solver_forward_range(NeuralNetworkSolver *solver, Matrix *input, int from, int to){
+    if(!solver_check_valid(solver)) return;
     
     NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
-    NeuralNetwork *network = h_solver->network;
     List *layers = h_solver->layers;
-    unsigned int i = 0;
-    unsigned const int lim = listGetSize(layers);
+    int i;
     
-    Matrix **a = &input;
-    void *flayer;
-    //void *flayer = *((void **) listGet(layers, i));
+    //Later stages start from the output of the layer before them
+    Matrix *a = from == 0 ? input : *(LIST_DER(Matrix **, listGet(layers, from - 1)));
+    Matrix **a_ptr = &a;
     
-    //h_solver->step_forward(network, flayer, a);    
-    for(i = 0; i < lim; i++){
-        flayer = *((void **) listGet(layers, i));
-        h_solver->step_forward(flayer, a);
+    //A smaller batch than the layers hold (the tail of an epoch) runs on the first columns only
+    if(from == 0 && matrixGetM(input) != h_solver->columns){
+        h_solver->columns = matrixGetM(input);
+        for(i = 0; i < listGetSize(layers); i++){
+            h_solver->set_columns(*((void **) listGet(layers, i)), h_solver->columns, h_solver->batch_size);
+        }
+    }
+    
+    for(i = from; i < to; i++){
+        SOLVER_PROFILED(h_solver, i, NEURAL_PROFILE_FORWARD, h_solver->step_forward(*((void **) listGet(layers, i)), a_ptr));
     }
 }
 
-void neural_network_back_propagate(NeuralNetworkSolver *solver, Matrix *input, Matrix *y){
-    if(!solver_check_valid(solver) || !hidden_solver_check_valid(solver->hidden_solver) /*Add matrix check later*/) return;
+void solver_backward_range(NeuralNetworkSolver *solver, Matrix *input, Matrix *y, int from, int to){
+    if(!solver_check_valid(solver)) return;
     
-    NeuralNetwork *network = solver->hidden_solver->network;
     NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
-    List *layers = solver->hidden_solver->layers;
-    int i = listGetSize(layers) - 1;
+    List *layers = h_solver->layers;
+    //The update is averaged over the samples of the batch
+    const int columns = h_solver->columns;
+    int i = to - 1;
     
     void *flayer;
     void *blayer = *((void **) listGet(layers, i));
     
     //Update {blayer->da, blayer:[a,da], y} 
-    h_solver->d_cost(blayer, y);
+    if(to == listGetSize(layers)) h_solver->d_cost(blayer, y);
     
-    for(i = i - 1; i >= 0; i--){
+    for(i = i - 1; i >= from - 1 && i >= 0; i--){
         flayer = blayer;
         blayer = *((void **) listGet(layers, i));
         
         //Update {flayer->dz, flayer:[z, a, da, dz]}
-        h_solver->dz_solver(flayer);
+        SOLVER_PROFILED(h_solver, i + 1, NEURAL_PROFILE_DZ, h_solver->dz_solver(flayer));
         
         //Update {blayer->da, blayer:[da], flayer:[w,dz]}
-        h_solver->da_solver(flayer, blayer);
+        SOLVER_PROFILED(h_solver, i + 1, NEURAL_PROFILE_DA, h_solver->da_solver(flayer, blayer));
         
         //Update {[flayer->b, flayer->w], blayer:[a], flayer:[dz,b,w]}
-        h_solver->dw_db_solver(flayer, blayer, h_solver->rate);
+        SOLVER_PROFILED(h_solver, i + 1, NEURAL_PROFILE_DW_DB, h_solver->dw_db_solver(h_solver, flayer, blayer, columns));
     }
+    if(from > 0) return;
+    
     flayer = blayer;
     
     //Update {flayer->dz, flayer:[z, a, da, dz]}
-    h_solver->dz_solver(flayer);
+    SOLVER_PROFILED(h_solver, 0, NEURAL_PROFILE_DZ, h_solver->dz_solver(flayer));
     
     //Update {[flayer->b, flayer->w], blayer:[a], flayer:[dz,b,w]}
-    h_solver->dw_db_solver(flayer, &input, h_solver->rate);
+    SOLVER_PROFILED(h_solver, 0, NEURAL_PROFILE_DW_DB, h_solver->dw_db_solver(h_solver, flayer, &input, columns));
+}
+
+void neural_network_forward_propagate(NeuralNetworkSolver *solver, Matrix *input){
+    if(input == NULL || !solver_check_valid(solver)) return;
+    if(solver->hidden_solver->frozen){
+        fprintf(stderr, "Error in forward propagation. The network is frozen, use its inference functions.\n");
+        return;
+    }
+    
+    solver_forward_range(solver, input, 0, listGetSize(solver->hidden_solver->layers));
+}
+
+/**
+ * Averages the parameters over every process (the master weights of mixed precision, then refreshing their shadow).
+ **/
+static void solver_average_master(NeuralNetworkHiddenSolver *h_solver){
+    if(h_solver->weights == NULL){
+        allreduceAverage(h_solver->comm, h_solver->params);
+        return;
+    }
+    
+    allreduceAverage(h_solver->comm, h_solver->weights);
+    matrixConvert(h_solver->weights, h_solver->params, MATRIX_FLOAT32);
+}
+
+/**
+ * Averages the parameters over every process when the last update ends a period.
+ **/
+static void solver_allreduce_parameters(NeuralNetworkHiddenSolver *h_solver){
+    if(h_solver->comm != NULL && h_solver->comm_mode == NEURAL_ALLREDUCE_PARAMETERS && h_solver->steps % h_solver->comm_period == 0){
+        solver_average_master(h_solver);
+    }
+}
+
+/**
+ * Counts one weight update. Shared replicas update their master's weights and moments, so they count on its counter,
+ * which Hogwild workers bump side by side, and bias-correct with the step their update actually is.
+ **/
+static void solver_count_step(NeuralNetworkHiddenSolver *h_solver){
+    if(h_solver->master != NULL && h_solver->replica == SOLVER_REPLICA_SHARED){
+        h_solver->steps = __atomic_add_fetch(&h_solver->master->steps, 1, __ATOMIC_RELAXED);
+    }else{
+        h_solver->steps++;
+    }
+}
+
+void neural_network_back_propagate(NeuralNetworkSolver *solver, Matrix *input, Matrix *y){
+    if(!solver_check_valid(solver) || !hidden_solver_check_valid(solver->hidden_solver) /*Add matrix check later*/) return;
+    if(solver->hidden_solver->frozen){
+        fprintf(stderr, "Error in back propagation. The network is frozen and can't be trained.\n");
+        return;
+    }
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    
+    //The layers only leave their gradient sums behind, which have to be averaged with the other processes' before the update
+    if(h_solver->comm != NULL && h_solver->comm_mode == NEURAL_ALLREDUCE_GRADIENTS){
+        solver_backward_range(solver, input, y, 0, listGetSize(h_solver->layers));
+        solver_apply_gradients(solver, h_solver->grads, h_solver->columns);
+        return;
+    }
+    
+    solver_count_step(h_solver);
+    solver_backward_range(solver, input, y, 0, listGetSize(h_solver->layers));
+    
+    //Every w and b at once, now that no layer needs the old weights anymore
+    if(h_solver->update != NULL){
+        const double start = h_solver->profile != NULL ? solver_clock() : 0;
+        
+        h_solver->update(h_solver, h_solver->grads);
+        if(h_solver->profile != NULL) solver_profile_update(h_solver, start);
+    }
+    solver_allreduce_parameters(h_solver);
+}
+
+void solver_apply_gradients(NeuralNetworkSolver *solver, Matrix *grads, int columns){
+    if(!solver_check_valid(solver) || grads == NULL || columns < 1) return;
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    
+    //Every process sums the same number of samples, so the average of the sums divided by columns is the whole batch's average
+    if(h_solver->comm != NULL && h_solver->comm_mode == NEURAL_ALLREDUCE_GRADIENTS) allreduceAverage(h_solver->comm, grads);
+    
+    const double start = h_solver->profile != NULL ? solver_clock() : 0;
+    
+    solver_count_step(h_solver);
+    if(h_solver->update == NULL){
+        //Plain SGD: w += rate * average gradient
+        matrixConstantMul(grads, h_solver->rate / columns);
+        matrixAdd(h_solver->params, grads, h_solver->params, 0);
+    }else{
+        matrixConstantMul(grads, 1.0 / columns);
+        h_solver->update(h_solver, grads);
+    }
+    if(h_solver->profile != NULL) solver_profile_update(h_solver, start);
+    solver_allreduce_parameters(h_solver);
+}
+
+void solver_average_parameters(NeuralNetworkSolver *solver){
+    if(!solver_check_valid(solver)) return;
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    
+    if(h_solver->comm != NULL && h_solver->comm_mode == NEURAL_ALLREDUCE_PARAMETERS) solver_average_master(h_solver);
+}
+
+Matrix *solver_get_parameters(NeuralNetworkSolver *solver){
+    if(!solver_check_valid(solver)) return NULL;
+    
+    return solver->hidden_solver->params;
+}
+
+Matrix *solver_get_gradients(NeuralNetworkSolver *solver){
+    if(!solver_check_valid(solver)) return NULL;
+    
+    return solver->hidden_solver->grads;
+}
+
+void solver_set_profiling(NeuralNetworkSolver *solver, char enabled){
+    if(!solver_check_valid(solver)) return;
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    
+    free(h_solver->profile);
+    h_solver->profile = NULL;
+    h_solver->profile_rows = 0;
+    if(!enabled) return;
+    
+    h_solver->profile_rows = (h_solver->layers != NULL ? listGetSize(h_solver->layers) : 0) + 1;
+    h_solver->profile = calloc(h_solver->profile_rows, sizeof(*h_solver->profile));
+    assert(h_solver->profile != NULL);
+}
+
+/**
+ * Adds the counters of source (a replica, whose calls ran alongside others) to those of target.
+ **/
+static void solver_profile_merge(NeuralNetworkHiddenSolver *target, NeuralNetworkHiddenSolver *source){
+    const int rows = target->profile_rows < source->profile_rows ? target->profile_rows : source->profile_rows;
+    int i, k;
+    
+    for(i = 0; i < rows; i++){
+        for(k = 0; k < NEURAL_PROFILE_KERNELS; k++){
+            target->profile[i][k].seconds += source->profile[i][k].seconds;
+            target->profile[i][k].flops += source->profile[i][k].flops;
+            target->profile[i][k].bytes += source->profile[i][k].bytes;
+            target->profile[i][k].calls += source->profile[i][k].calls;
+        }
+    }
+}
+
+char solver_get_profile(NeuralNetworkSolver *solver, int layer, int kernel, NeuralProfile *profile){
+    if(!solver_check_valid(solver) || profile == NULL || kernel < 0 || kernel >= NEURAL_PROFILE_KERNELS) return 0;
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    int i;
+    
+    if(h_solver->profile == NULL || layer < 0 || layer >= h_solver->profile_rows) return 0;
+    
+    *profile = h_solver->profile[layer][kernel];
+    if(layer != 0) return 1;
+    
+    //Row 0 only keeps the update, the network's other kernels are the sums over its layers
+    for(i = 1; i < h_solver->profile_rows; i++){
+        profile->seconds += h_solver->profile[i][kernel].seconds;
+        profile->flops += h_solver->profile[i][kernel].flops;
+        profile->bytes += h_solver->profile[i][kernel].bytes;
+        profile->calls += h_solver->profile[i][kernel].calls;
+    }
+    
+    return 1;
+}
+
+Matrix *solver_copy_parameters(NeuralNetworkSolver *solver, Matrix *copy){
+    if(!solver_check_valid(solver) || solver->hidden_solver->params == NULL) return copy;
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    Matrix *source = h_solver->weights != NULL ? h_solver->weights : h_solver->params;
+    
+    return matrixConvert(source, copy, matrixGetType(source));
+}
+
+void solver_restore_parameters(NeuralNetworkSolver *solver, Matrix *copy){
+    if(!solver_check_valid(solver) || copy == NULL || solver->hidden_solver->params == NULL) return;
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    
+    if(h_solver->weights != NULL) matrixConvert(copy, h_solver->weights, MATRIX_FLOAT64);
+    matrixConvert(copy, h_solver->params, h_solver->type);
+}
+
+Matrix *solver_copy_moment(NeuralNetworkSolver *solver, int moment, Matrix *copy){
+    if(!solver_check_valid(solver) || moment < 0 || moment > 1 || solver->hidden_solver->moments[moment] == NULL) return copy;
+    
+    return matrixConvert(solver->hidden_solver->moments[moment], copy, matrixGetType(solver->hidden_solver->moments[moment]));
+}
+
+void solver_restore_moment(NeuralNetworkSolver *solver, int moment, Matrix *copy){
+    if(!solver_check_valid(solver) || copy == NULL || moment < 0 || moment > 1 || solver->hidden_solver->moments[moment] == NULL) return;
+    
+    matrixConvert(copy, solver->hidden_solver->moments[moment], matrixGetType(solver->hidden_solver->moments[moment]));
+}
+
+char solver_has_moment(NeuralNetworkSolver *solver, int moment){
+    return solver_check_valid(solver) && moment >= 0 && moment <= 1 && solver->hidden_solver->moments[moment] != NULL;
+}
+
+long solver_get_steps(NeuralNetworkSolver *solver){
+    return solver_check_valid(solver) ? solver->hidden_solver->steps : 0;
+}
+
+void solver_set_steps(NeuralNetworkSolver *solver, long steps){
+    if(solver_check_valid(solver) && steps >= 0) solver->hidden_solver->steps = steps;
+}
+
+double solver_allreduce_value(NeuralNetworkSolver *solver, double value){
+    if(!solver_check_valid(solver) || solver->hidden_solver->comm == NULL) return value;
+    
+    Matrix *mean = matrixCreate(1, 1, &value, 1);
+    allreduceAverage(solver->hidden_solver->comm, mean);
+    value = matrixGetValue(mean, 0, 0);
+    matrixDestroy(mean, 0);
+    
+    return value;
+}
+
+void solver_destroy(NeuralNetworkSolver *solver){
+    if(!solver_check_valid(solver)) return;
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    int i;
+    
+    //A replica's counters go to the solver it was made from
+    if(h_solver->profile != NULL){
+        if(h_solver->master != NULL && h_solver->master->profile != NULL) solver_profile_merge(h_solver->master, h_solver);
+        free(h_solver->profile);
+    }
+    
+    //The layers' w, b, dw and db are views, so they go before the arenas
+    if(h_solver->layers != NULL) listDestroy(h_solver->layers);
+    if(h_solver->grads != NULL && (h_solver->master == NULL || h_solver->grads != h_solver->master->grads)) matrixDestroy(h_solver->grads, 0);
+    matrixDestroy(h_solver->sparse_w, 0);
+    matrixDestroy(h_solver->sparse_x, 0);
+    free(h_solver->sparse_rows);
+    if(h_solver->master == NULL){
+        if(h_solver->params != NULL) matrixDestroy(h_solver->params, 0);
+        if(h_solver->weights != NULL) matrixDestroy(h_solver->weights, 0);
+        for(i = 0; i < 2; i++){
+            if(h_solver->moments[i] != NULL) matrixDestroy(h_solver->moments[i], 0);
+        }
+    }
+    if(h_solver->mapping != NULL) munmap(h_solver->mapping, h_solver->mapping_size);
+    
+    free(h_solver);
+    free(solver);
 }
 
 
@@ -124,52 +547,329 @@ void neural_network_back_propagate(NeuralNetworkSolver *solver, Matrix *input, M
 
 typedef struct generic_neural_layer{
     Matrix *a, *b, *w, *z, *da, *db, *dw, *dz;
+    Matrix *batch[4];   /*n x batch_size storage behind a, z, da and dz (which are views of it when fewer columns are in use)*/
      void (* activation_function)(Matrix *, Matrix *);
-     Matrix *(* d_activation_function)(Matrix *, Matrix *);
+     void (* d_activation_function)(Matrix *, Matrix *, Matrix *, Matrix *);   /*(z, a, da, dz): dz = da * f'(z) elementwise*/
+     int activation_flag;
 } Generic_Neural_Layer;
 
+static Matrix *generic_layer_weights(void *target){
+    return ((Generic_Neural_Layer *) target)->w;
+}
+
+//The per-sample matrices of a layer, in the order of Generic_Neural_Layer.batch
+#define GENERIC_LAYER_ACTIVE(LAYER) {&(LAYER)->a, &(LAYER)->z, &(LAYER)->da, &(LAYER)->dz}
+
+/**
+ * Frees everything of a layer but w and b: the batch's activations and their gradients, and dw and db.
+ **/
+static void generic_layer_release(Generic_Neural_Layer *layer){
+    Matrix **active[4] = GENERIC_LAYER_ACTIVE(layer);
+    int i;
+    
+    //Views of the batch storage go first, then the storage itself
+    for(i = 0; i < 4; i++){
+        if(*active[i] != layer->batch[i]) matrixDestroy(*active[i], 0);
+        matrixDestroy(layer->batch[i], 0);
+        *active[i] = layer->batch[i] = NULL;
+    }
+    
+    if(layer->db != NULL) matrixDestroy(layer->db, 0);
+    if(layer->dw != NULL) matrixDestroy(layer->dw, 0);
+    layer->db = layer->dw = NULL;
+}
+
 void generic_neural_layer_destroyer(void *target){
-    Generic_Neural_Layer layer = *((Generic_Neural_Layer *)target);
+    Generic_Neural_Layer *layer = *((Generic_Neural_Layer **)target);
     
-    //Could treat it as a Matrix ** and iterate through the "array" but eh... hardcode!
+    generic_layer_release(layer);
+    if(layer->b != NULL) matrixDestroy(layer->b, 0);
+    if(layer->w != NULL) matrixDestroy(layer->w, 0);
+    free(layer);
+}
+
+/**
+ * Operations and bytes a kernel needs on an n x m layer (n outputs, m inputs) running columns samples.
+ **/
+static void generic_layer_cost(void *target, int kernel, int columns, char type, double *flops, double *bytes){
+    Generic_Neural_Layer *layer = (Generic_Neural_Layer *) target;
+    const double n = matrixGetN(layer->w), m = matrixGetM(layer->w), c = columns;
+    const double size = type == MATRIX_FLOAT32 ? sizeof(float) : sizeof(double);
     
-    if(layer.a != NULL) matrixDestroy(layer.a, 0);
-    if(layer.b != NULL) matrixDestroy(layer.b, 0);
-    if(layer.w != NULL) matrixDestroy(layer.w, 0);
-    if(layer.z != NULL) matrixDestroy(layer.z, 0);
-    if(layer.da != NULL) matrixDestroy(layer.da, 0);
-    if(layer.db != NULL) matrixDestroy(layer.db, 0);
-    if(layer.dw != NULL) matrixDestroy(layer.dw, 0);
-    if(layer.dz != NULL) matrixDestroy(layer.dz, 0);
+    switch(kernel){
+        case NEURAL_PROFILE_FORWARD:
+            //w * a, the bias and the activation. Reads w, a and b, writes z and a.
+            *flops = 2 * n * m * c + 2 * n * c;
+            *bytes = (n * m + m * c + n + 2 * n * c) * size;
+            break;
+        case NEURAL_PROFILE_DZ:
+            //da times the derivative. Reads da and z (or a), writes dz.
+            *flops = 2 * n * c;
+            *bytes = 3 * n * c * size;
+            break;
+        case NEURAL_PROFILE_DA:
+            //w^T * dz. Reads w and dz, writes the previous layer's da.
+            *flops = 2 * n * m * c;
+            *bytes = (n * m + n * c + m * c) * size;
+            break;
+        default:
+            //Scaling dz, dz * a^T and the sum of dz's columns. Reads dz and a, writes dw and db (or w and b).
+            *flops = 2 * n * m * c + 2 * n * c;
+            *bytes = (n * c + m * c + n * m + n) * size;
+            break;
+    }
 }
 
 List *generic_init_layers(){
     return listCreate(2, sizeof(Generic_Neural_Layer *), NULL, generic_neural_layer_destroyer); 
 }
 
-void generic_create_layer(NeuralNetworkSolver *solver, int size, int activation_function_flag){
-//     (void) solver;
-//     (void) size;
+/**
+ * Creates an n x m layer matrix of the solver's element type, filled with values (zeros if NULL).
+ **/
+static Matrix *generic_layer_matrix(int n, int m, double *values, char type){
+    Matrix *ret = matrixCreate(n, m, values, n * m);
+    
+    if(ret != NULL && type != MATRIX_FLOAT64){
+        Matrix *converted = matrixConvert(ret, NULL, type);
+        matrixDestroy(ret, 0);
+        ret = converted;
+    }
+    
+    return ret;
+}
+
+/**
+ * A zeroed 1 x size arena of the given element type.
+ **/
+static Matrix *solver_arena_create(long size, char type){
+    Matrix *ret = type == MATRIX_FLOAT32 ? matrixCreateF(1, (int) size, NULL, (int) size) : matrixCreate(1, (int) size, NULL, (int) size);
+    assert(ret != NULL);
     
-    /**
-     * TODO
-     **/
+    return ret;
+}
+
+/**
+ * Moves *matrix (values included) into the block at offset of arena.
+ **/
+static void solver_arena_adopt(Matrix *arena, Matrix **matrix, long offset){
+    Matrix *view = matrixViewArena(arena, offset, matrixGetN(*matrix), matrixGetM(*matrix));
+    assert(view != NULL);
+    
+    matrixConvert(*matrix, view, matrixGetType(view));
+    matrixDestroy(*matrix, 0);
+    *matrix = view;
+}
+
+/**
+ * Copies old (destroyed, if not NULL) over the start of the bigger arena grown and returns grown.
+ **/
+static Matrix *solver_arena_grow(Matrix *old, Matrix *grown){
+    if(old == NULL) return grown;
+    
+    Matrix *prefix = matrixView(grown, 0, 0, 1, matrixGetM(old));
+    matrixConvert(old, prefix, matrixGetType(grown));
+    matrixDestroy(prefix, 0);
+    matrixDestroy(old, 0);
+    
+    return grown;
+}
+
+/**
+ * Lays the w and b of every layer out back to back in one parameter arena, and their dw and db at the same offsets in a gradient arena.
+ * Called whenever a layer is added, so the layers' matrices (arena views or not) are moved into freshly sized arenas.
+ **/
+static void solver_arena_build(NeuralNetworkHiddenSolver *h_solver){
+    const int lim = listGetSize(h_solver->layers);
+    const char type = h_solver->type;
+    Generic_Neural_Layer *layer;
+    long size = 0, offset = 0;
+    int i;
+    
+    for(i = 0; i < lim; i++){
+        layer = *((Generic_Neural_Layer **) listGet(h_solver->layers, i));
+        size += matrixArenaSize(matrixGetN(layer->w), matrixGetM(layer->w), type) + matrixArenaSize(matrixGetN(layer->b), 1, type);
+    }
     
+    Matrix *params = solver_arena_create(size, type), *grads = solver_arena_create(size, type);
+    
+    for(i = 0; i < lim; i++){
+        layer = *((Generic_Neural_Layer **) listGet(h_solver->layers, i));
+        
+        solver_arena_adopt(params, &layer->w, offset);
+        solver_arena_adopt(grads, &layer->dw, offset);
+        offset += matrixArenaSize(matrixGetN(layer->w), matrixGetM(layer->w), type);
+        
+        solver_arena_adopt(params, &layer->b, offset);
+        solver_arena_adopt(grads, &layer->db, offset);
+        offset += matrixArenaSize(matrixGetN(layer->b), 1, type);
+    }
+    
+    if(h_solver->params != NULL) matrixDestroy(h_solver->params, 0);
+    if(h_solver->grads != NULL) matrixDestroy(h_solver->grads, 0);
+    h_solver->params = params;
+    h_solver->grads = grads;
+    
+    //The new layer's master weights start from its initial values, the others keep the precision they have
+    if(h_solver->mixed){
+        Matrix *weights = matrixConvert(params, NULL, MATRIX_FLOAT64);
+        assert(weights != NULL);
+        h_solver->weights = solver_arena_grow(h_solver->weights, weights);
+    }
+    
+    //Layers are only ever appended, so the optimizer state keeps its offsets and just grows
+    for(i = 0; i < 2; i++){
+        if(!(h_solver->state & (1 << i))) continue;
+        
+        h_solver->moments[i] = solver_arena_grow(h_solver->moments[i], solver_arena_create(size, h_solver->mixed ? MATRIX_FLOAT64 : type));
+    }
+}
+
+/**
+ * A layer shaped like source with its own activation buffers and with w, b, dw and db at offset of the given arenas.
+ **/
+static Generic_Neural_Layer *generic_replicate_layer(Generic_Neural_Layer *source, Matrix *params, Matrix *grads, long offset, int batch_size){
     Generic_Neural_Layer *layer = (Generic_Neural_Layer *) calloc(1, sizeof(Generic_Neural_Layer));
     assert(layer != NULL);
     
-    layer->a = matrixCreate(size, 1, NULL, size);
-    assert(layer->a != NULL);
-    layer->da = matrixCreate(size, 1, NULL, size);
-    assert(layer->da != NULL);
-    layer->b = matrixCreate(size, 1, NULL, size);
+    const char type = matrixGetType(source->w);
+    const int n = matrixGetN(source->w), m = matrixGetM(source->w);
+    Matrix **active[4] = GENERIC_LAYER_ACTIVE(layer);
+    int i;
+    
+    for(i = 0; i < 4; i++){
+        layer->batch[i] = generic_layer_matrix(n, batch_size, NULL, type);
+        assert(layer->batch[i] != NULL);
+        *active[i] = layer->batch[i];
+    }
+    
+    layer->w = matrixViewArena(params, offset, n, m);
+    layer->dw = matrixViewArena(grads, offset, n, m);
+    offset += matrixArenaSize(n, m, type);
+    layer->b = matrixViewArena(params, offset, n, 1);
+    layer->db = matrixViewArena(grads, offset, n, 1);
+    assert(layer->w != NULL && layer->dw != NULL && layer->b != NULL && layer->db != NULL);
+    
+    layer->activation_function = source->activation_function;
+    layer->d_activation_function = source->d_activation_function;
+    layer->activation_flag = source->activation_flag;
+    
+    return layer;
+}
+
+/**
+ * dw = dz * a^T and db = sum of dz's columns, unscaled so that the sums of several replicas can be added up.
+ **/
+void generic_gradient_solver(NeuralNetworkHiddenSolver *h_solver, void *fl, void *bl, int columns){
+    Generic_Neural_Layer *flayer = (Generic_Neural_Layer *) fl;
+    (void) h_solver;
+    (void) columns;
+    
+    matrixMul(flayer->dz, ((Generic_Neural_Layer *) bl)->a, flayer->dw, MATRIX_B_TRANS);
+    matrixReduceCols(flayer->dz, flayer->db, 0);
+}
+
+/**
+ * Like generic_gradient_solver(), but adding to what dw and db already hold.
+ **/
+void generic_gradient_add_solver(NeuralNetworkHiddenSolver *h_solver, void *fl, void *bl, int columns){
+    Generic_Neural_Layer *flayer = (Generic_Neural_Layer *) fl;
+    (void) h_solver;
+    (void) columns;
+    
+    matrixMul(flayer->dz, ((Generic_Neural_Layer *) bl)->a, flayer->dw, MATRIX_B_TRANS | MATRIX_RESULT_ADD);
+    matrixReduceCols(flayer->dz, flayer->db, MATRIX_RESULT_ADD);
+}
+
+void solver_set_allreduce(NeuralNetworkSolver *solver, Allreduce *comm, char mode, int period){
+    if(!solver_check_valid(solver)) return;
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    
+    //Back to the solver's own weight update before anything else
+    if(h_solver->comm != NULL && h_solver->comm_mode == NEURAL_ALLREDUCE_GRADIENTS) h_solver->dw_db_solver = h_solver->local_dw_db_solver;
+    
+    h_solver->comm = comm;
+    h_solver->comm_mode = mode;
+    h_solver->comm_period = period < 1 ? 1 : period;
+    
+    if(comm != NULL && mode == NEURAL_ALLREDUCE_GRADIENTS){
+        h_solver->local_dw_db_solver = h_solver->dw_db_solver;
+        h_solver->dw_db_solver = generic_gradient_solver;
+    }
+}
+
+NeuralNetworkSolver *solver_replica_create(NeuralNetworkSolver *solver, char mode){
+    if(!solver_check_valid(solver) || !hidden_solver_check_valid(solver->hidden_solver) || solver->hidden_solver->params == NULL) return NULL;
+    
+    NeuralNetworkHiddenSolver *master = solver->hidden_solver;
+    NeuralNetworkSolver *ret = (NeuralNetworkSolver *) malloc(sizeof(NeuralNetworkSolver));
+    assert(ret != NULL);
+    NeuralNetworkHiddenSolver *h_solver = (NeuralNetworkHiddenSolver *) malloc(sizeof(struct _neural_network_hidden_solver));
+    assert(h_solver != NULL);
+    
+    //Same callbacks and hyperparameters, then swap in the replica's own buffers
+    *ret = *solver;
+    *h_solver = *master;
+    ret->hidden_solver = h_solver;
+    const int lim = listGetSize(master->layers);
+    long offset = 0;
+    int i;
+    
+    h_solver->master = master;
+    h_solver->replica = mode;
+    h_solver->columns = h_solver->batch_size;
+    
+    //Only the master talks to the other processes, and shared replicas update the weights the solver's own way
+    if(master->comm != NULL && master->comm_mode == NEURAL_ALLREDUCE_GRADIENTS) h_solver->dw_db_solver = master->local_dw_db_solver;
+    h_solver->comm = NULL;
+    
+    //Replicas run side by side, so each counts on its own and hands its counts over when destroyed
+    if(master->profile != NULL){
+        h_solver->profile = calloc(master->profile_rows, sizeof(*h_solver->profile));
+        assert(h_solver->profile != NULL);
+    }
+    if(mode != SOLVER_REPLICA_SHARED){
+        h_solver->dw_db_solver = mode == SOLVER_REPLICA_GRADIENTS ? generic_gradient_solver : generic_gradient_add_solver;
+        h_solver->update = NULL;
+    }else if(h_solver->dw_db_solver == sgd_dw_dz_solver){
+        //Side by side with other workers, SGD only writes the first layer's weights of the inputs a batch actually has
+        h_solver->dw_db_solver = sgd_sparse_dw_db_solver;
+    }
+    h_solver->grads = mode == SOLVER_REPLICA_ACCUMULATE ? master->grads : solver_arena_create(matrixGetM(master->grads), master->type);
+    h_solver->layers = h_solver->init_layers();
+    assert(h_solver->layers != NULL);
+    
+    for(i = 0; i < lim; i++){
+        Generic_Neural_Layer *source = *((Generic_Neural_Layer **) listGet(master->layers, i));
+        Generic_Neural_Layer *layer = generic_replicate_layer(source, master->params, h_solver->grads, offset, h_solver->batch_size);
+        
+        listAppend(h_solver->layers, &layer);
+        offset += matrixArenaSize(matrixGetN(source->w), matrixGetM(source->w), master->type) + matrixArenaSize(matrixGetN(source->b), 1, master->type);
+    }
+    
+    return ret;
+}
+
+/**
+ * Builds the generic part of a new layer of the given size in place. Solvers with bigger layers embed it first and allocate the rest themselves.
+ **/
+static void generic_fill_layer(NeuralNetworkSolver *solver, Generic_Neural_Layer *layer, int size, int activation_function_flag){
+    const char type = solver->hidden_solver->type;
+    const int batch_size = solver->hidden_solver->batch_size;
+    Matrix **active[4] = GENERIC_LAYER_ACTIVE(layer);
+    int i;
+    
+    //One column per sample of the batch for a, z, da and dz
+    for(i = 0; i < 4; i++){
+        layer->batch[i] = generic_layer_matrix(size, batch_size, NULL, type);
+        assert(layer->batch[i] != NULL);
+        *active[i] = layer->batch[i];
+    }
+    layer->b = generic_layer_matrix(size, 1, NULL, type);
     assert(layer->b != NULL);
-    layer->db = matrixCreate(size, 1, NULL, size);
+    layer->db = generic_layer_matrix(size, 1, NULL, type);
     assert(layer->db != NULL);
-    layer->z = matrixCreate(size, 1, NULL, size);
-    assert(layer->z != NULL);
-    layer->dz = matrixCreate(size, 1, NULL, size);
-    assert(layer->dz != NULL);
     
     int prev = solver_get_num_layers(solver) - 1;
     
@@ -179,21 +879,56 @@ void generic_create_layer(NeuralNetworkSolver *solver, int size, int activation_
         prev = solver->hidden_solver->input_size;
     } 
     
-    double values[size * prev];
+    //Xavier (Glorot) for the sigmoid, He for relu, both as uniform draws of the same variance
+    const double limit = activation_function_flag == ACTIV_FUNC_RELU ? sqrt(6.0 / prev) : sqrt(6.0 / (prev + size));
     
-    for(int i = 0; i < size * prev; i++){
-        values[i] = ((rand() % 501) - 250) / 100.0;
-    }
-    
-    layer->w = matrixCreate(size, prev, values, size * prev);
+    layer->w = generic_layer_matrix(size, prev, NULL, type);
     assert(layer->w != NULL);
+    matrixFillUniform(layer->w, -limit, limit, solver->hidden_solver->seed, listGetSize(solver->hidden_solver->layers));
     
-    layer->dw = matrixCreate(size, prev, NULL, size * prev);
+    layer->dw = generic_layer_matrix(size, prev, NULL, type);
     assert(layer->dw != NULL);
     
     activ_fun_set_fun(&(layer->activation_function), &(layer->d_activation_function), activation_function_flag);
+    layer->activation_flag = activation_function_flag;
     
+    //Match the other layers if a partial batch is currently in use
+    if(solver->hidden_solver->columns != batch_size){
+        generic_layer_set_columns(layer, solver->hidden_solver->columns, batch_size);
+    }
+}
+
+void generic_create_layer(NeuralNetworkSolver *solver, int size, int activation_function_flag){
+    Generic_Neural_Layer *layer = (Generic_Neural_Layer *) calloc(1, sizeof(Generic_Neural_Layer));
+    assert(layer != NULL);
+    
+    generic_fill_layer(solver, layer, size, activation_function_flag);
     listAppend(solver->hidden_solver->layers, &layer);
+    solver_arena_build(solver->hidden_solver);
+}
+
+/**
+ * Points a, z, da and dz at the first columns of the layer's batch storage, reallocating the storage first if it doesn't hold batch_size columns.
+ **/
+void generic_layer_set_columns(void *target, int columns, int batch_size){
+    Generic_Neural_Layer *layer = (Generic_Neural_Layer *) target;
+    Matrix **active[4] = GENERIC_LAYER_ACTIVE(layer);
+    const int n = matrixGetN(layer->a);
+    int i;
+    
+    for(i = 0; i < 4; i++){
+        if(*active[i] != layer->batch[i]) matrixDestroy(*active[i], 0);
+        
+        if(matrixGetM(layer->batch[i]) != batch_size){
+            Matrix *storage = generic_layer_matrix(n, batch_size, NULL, matrixGetType(layer->batch[i]));
+            assert(storage != NULL);
+            matrixDestroy(layer->batch[i], 0);
+            layer->batch[i] = storage;
+        }
+        
+        *active[i] = columns == batch_size ? layer->batch[i] : matrixView(layer->batch[i], 0, 0, n, columns);
+        assert(*active[i] != NULL);
+    }
 }
 
 NeuralNetworkSolver *generic_neural_network_solver_create(double alpha, double rate){
@@ -208,6 +943,9 @@ NeuralNetworkSolver *generic_neural_network_solver_create(double alpha, double r
     ret->hidden_solver->rate = rate;
     ret->hidden_solver->init_layers = generic_init_layers;
     ret->hidden_solver->create_layer = generic_create_layer;
+    ret->hidden_solver->set_columns = generic_layer_set_columns;
+    ret->hidden_solver->batch_size = 1;
+    ret->hidden_solver->columns = 1;
     
     return ret;
 }
@@ -229,6 +967,359 @@ void generic_add_output_layer(NeuralNetworkSolver *solver, int size){
 }
 
 
+/**
+ * Inference
+ **/
+
+struct _solver_inference{
+    Matrix *buffers[2];     /*Widest layer x capacity, which the layers write to in turn*/
+    Matrix **outputs;       /*Every layer's n x columns view of the buffer it writes to*/
+    Matrix *packed;         /*Input size x capacity, holding samples gathered from a list*/
+    Matrix *input, *column; /*Views of packed: its first columns, and the one a sample is copied into*/
+    int layers;     /*Layers the buffers were sized for*/
+    int capacity;   /*Columns allocated*/
+    int columns;    /*Columns the views currently span*/
+};
+
+static void solver_inference_clear(SolverInference *inference){
+    int i;
+    
+    //Views go before the buffers under them
+    for(i = 0; i < inference->layers; i++){
+        matrixDestroy(inference->outputs[i], 0);
+    }
+    free(inference->outputs);
+    matrixDestroy(inference->input, 0);
+    matrixDestroy(inference->column, 0);
+    matrixDestroy(inference->packed, 0);
+    for(i = 0; i < 2; i++){
+        matrixDestroy(inference->buffers[i], 0);
+    }
+    
+    memset(inference, 0, sizeof(SolverInference));
+}
+
+/**
+ * (Re)allocates the buffers for capacity columns of the solver's current layers.
+ **/
+static void solver_inference_build(NeuralNetworkHiddenSolver *h_solver, SolverInference *inference, int capacity){
+    const int layers = listGetSize(h_solver->layers);
+    Generic_Neural_Layer *layer;
+    int i, rows = 1;
+    
+    solver_inference_clear(inference);
+    
+    for(i = 0; i < layers; i++){
+        layer = LIST_DER(Generic_Neural_Layer *, listGet(h_solver->layers, i));
+        if(matrixGetN(layer->w) > rows) rows = matrixGetN(layer->w);
+    }
+    
+    inference->buffers[0] = generic_layer_matrix(rows, capacity, NULL, h_solver->type);
+    inference->buffers[1] = generic_layer_matrix(rows, capacity, NULL, h_solver->type);
+    inference->packed = generic_layer_matrix(h_solver->input_size, capacity, NULL, h_solver->type);
+    inference->outputs = (Matrix **) calloc(layers, sizeof(Matrix *));
+    assert(inference->buffers[0] != NULL && inference->buffers[1] != NULL && inference->packed != NULL && inference->outputs != NULL);
+    
+    for(i = 0; i < layers; i++){
+        layer = LIST_DER(Generic_Neural_Layer *, listGet(h_solver->layers, i));
+        inference->outputs[i] = matrixView(inference->buffers[i % 2], 0, 0, matrixGetN(layer->w), capacity);
+        assert(inference->outputs[i] != NULL);
+    }
+    inference->input = matrixView(inference->packed, 0, 0, h_solver->input_size, capacity);
+    inference->column = matrixView(inference->packed, 0, 0, h_solver->input_size, 1);
+    assert(inference->input != NULL && inference->column != NULL);
+    
+    inference->layers = layers;
+    inference->capacity = capacity;
+    inference->columns = capacity;
+}
+
+/**
+ * Makes every view span columns columns, allocating only when there are more of them (or other layers) than the buffers were made for.
+ **/
+static void solver_inference_reserve(NeuralNetworkHiddenSolver *h_solver, SolverInference *inference, int columns){
+    int i;
+    
+    if(inference->layers != listGetSize(h_solver->layers) || columns > inference->capacity){
+        solver_inference_build(h_solver, inference, columns > inference->capacity ? columns : inference->capacity);
+    }
+    if(columns == inference->columns) return;
+    
+    for(i = 0; i < inference->layers; i++){
+        matrixViewMove(inference->outputs[i], inference->buffers[i % 2], 0, 0, matrixGetN(inference->outputs[i]), columns);
+    }
+    matrixViewMove(inference->input, inference->packed, 0, 0, h_solver->input_size, columns);
+    inference->columns = columns;
+}
+
+SolverInference *solver_inference_create(NeuralNetworkSolver *solver, int capacity){
+    if(!solver_check_valid(solver) || solver->hidden_solver->layers == NULL || listGetSize(solver->hidden_solver->layers) == 0 || capacity < 1) return NULL;
+    
+    SolverInference *ret = (SolverInference *) calloc(1, sizeof(SolverInference));
+    assert(ret != NULL);
+    
+    solver_inference_build(solver->hidden_solver, ret, capacity);
+    
+    return ret;
+}
+
+Matrix *solver_inference_pack(NeuralNetworkSolver *solver, SolverInference *inference, List *input, int from, int count){
+    if(!solver_check_valid(solver) || inference == NULL || input == NULL || count < 1 || from < 0 || from + count > listGetSize(input)) return NULL;
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    Matrix *sample;
+    int k;
+    
+    solver_inference_reserve(h_solver, inference, count);
+    
+    for(k = 0; k < count; k++){
+        sample = LIST_DER(Matrix *, listGet(input, from + k));
+        if(sample == NULL || matrixGetN(sample) != h_solver->input_size || matrixGetM(sample) != 1){
+            fprintf(stderr, "Error in solver_inference_pack. Sample %d isn't %d x 1.\n", from + k, h_solver->input_size);
+            return NULL;
+        }
+        
+        matrixViewMove(inference->column, inference->packed, 0, k, h_solver->input_size, 1);
+        matrixConvert(sample, inference->column, h_solver->type);
+    }
+    
+    return inference->input;
+}
+
+Matrix *solver_infer(NeuralNetworkSolver *solver, SolverInference *inference, Matrix *input){
+    if(!solver_check_valid(solver) || inference == NULL || input == NULL) return NULL;
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    Generic_Neural_Layer *layer;
+    Matrix *a = input;
+    int i;
+    
+    if(h_solver->layers == NULL || listGetSize(h_solver->layers) == 0 || matrixGetN(input) != h_solver->input_size){
+        fprintf(stderr, "Error in solver_infer. Input has %d rows, the network takes %d.\n", matrixGetN(input), h_solver->input_size);
+        return NULL;
+    }
+    
+    solver_inference_reserve(h_solver, inference, matrixGetM(input));
+    
+    //Only reads w and b; every activation lands in the two buffers, so no z and no gradients are kept
+    for(i = 0; i < inference->layers; i++){
+        layer = LIST_DER(Generic_Neural_Layer *, listGet(h_solver->layers, i));
+        matrixMulBiasActivate(layer->w, a, layer->b, NULL, inference->outputs[i], layer->activation_flag);
+        a = inference->outputs[i];
+    }
+    
+    return a;
+}
+
+void solver_inference_destroy(SolverInference *inference){
+    if(inference == NULL) return;
+    
+    solver_inference_clear(inference);
+    free(inference);
+}
+
+
+/**
+ * Frozen solvers
+ **/
+
+void solver_freeze(NeuralNetworkSolver *solver){
+    if(!solver_check_valid(solver) || solver->hidden_solver->frozen || solver->hidden_solver->master != NULL || solver->hidden_solver->layers == NULL) return;
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    const int layers = listGetSize(h_solver->layers);
+    int i;
+    
+    //dw and db are views of the gradient arena, so they go before it
+    for(i = 0; i < layers; i++){
+        generic_layer_release(LIST_DER(Generic_Neural_Layer *, listGet(h_solver->layers, i)));
+    }
+    matrixDestroy(h_solver->grads, 0);
+    h_solver->grads = NULL;
+    
+    //The optimizer state, and the master weights whose float32 shadow the layers already use
+    matrixDestroy(h_solver->weights, 0);
+    h_solver->weights = NULL;
+    for(i = 0; i < 2; i++){
+        matrixDestroy(h_solver->moments[i], 0);
+        h_solver->moments[i] = NULL;
+    }
+    free(h_solver->profile);
+    h_solver->profile = NULL;
+    h_solver->profile_rows = 0;
+    h_solver->comm = NULL;
+    h_solver->state = 0;
+    h_solver->frozen = 1;
+}
+
+/**
+ * Model files
+ *
+ * A header, one entry per layer, then the parameter arena exactly as it sits in memory, starting on a page boundary.
+ * Loading maps the file and points the layers' w and b at the mapping, so nothing is parsed or copied and processes
+ * loading the same file share one copy of it in the page cache.
+ **/
+
+#define SOLVER_MODEL_MAGIC "NNCMODEL"
+#define SOLVER_MODEL_VERSION 1
+#define SOLVER_MODEL_BYTE_ORDER 0x01020304u  /*Reads back differently on a machine of the other endianness*/
+#define SOLVER_MODEL_ALIGN 4096     /*File offset of the arena, a page so that the mapped arena is MATRIX_ALIGN aligned*/
+
+typedef struct{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t type;          /*MATRIX_FLOAT64/MATRIX_FLOAT32 of every parameter*/
+    uint32_t input_size;
+    uint32_t layers;
+    uint32_t reserved;
+    uint64_t params_offset; /*Bytes from the start of the file to the arena*/
+    uint64_t params_size;   /*Elements in the arena*/
+} SolverModelHeader;
+
+typedef struct{
+    uint32_t n, m;          /*Nodes of the layer and of the one before it*/
+    uint32_t activation;    /*ACTIV_FUNC_* flag*/
+    uint32_t reserved;
+    uint64_t w_offset, b_offset;   /*Elements from the start of the arena*/
+} SolverModelLayer;
+
+char solver_save(NeuralNetworkSolver *solver, FILE *file){
+    if(!solver_check_valid(solver) || file == NULL || solver->hidden_solver->layers == NULL || listGetSize(solver->hidden_solver->layers) == 0) return 0;
+    
+    NeuralNetworkHiddenSolver *h_solver = solver->hidden_solver;
+    const int layers = listGetSize(h_solver->layers);
+    const size_t table = sizeof(SolverModelHeader) + layers * sizeof(SolverModelLayer);
+    SolverModelHeader header = {.magic = SOLVER_MODEL_MAGIC, .version = SOLVER_MODEL_VERSION, .byte_order = SOLVER_MODEL_BYTE_ORDER};
+    SolverModelLayer entry = {0};
+    Generic_Neural_Layer *layer;
+    long offset = 0;
+    size_t padding;
+    int i;
+    
+    header.type = h_solver->type;
+    header.input_size = h_solver->input_size;
+    header.layers = layers;
+    header.params_offset = ((table + SOLVER_MODEL_ALIGN - 1) / SOLVER_MODEL_ALIGN) * SOLVER_MODEL_ALIGN;
+    header.params_size = matrixGetM(h_solver->params);
+    if(fwrite(&header, sizeof(header), 1, file) != 1) return 0;
+    
+    //The arena's layout (see solver_arena_build()), so the offsets are those of the views
+    for(i = 0; i < layers; i++){
+        layer = LIST_DER(Generic_Neural_Layer *, listGet(h_solver->layers, i));
+        entry.n = matrixGetN(layer->w);
+        entry.m = matrixGetM(layer->w);
+        entry.activation = layer->activation_flag;
+        entry.w_offset = offset;
+        offset += matrixArenaSize(entry.n, entry.m, h_solver->type);
+        entry.b_offset = offset;
+        offset += matrixArenaSize(entry.n, 1, h_solver->type);
+        if(fwrite(&entry, sizeof(entry), 1, file) != 1) return 0;
+    }
+    
+    for(padding = header.params_offset - table; padding > 0; padding--){
+        if(fputc(0, file) == EOF) return 0;
+    }
+    
+    return matrixWriteRaw(h_solver->params, file) >= 0;
+}
+
+/**
+ * Checks what a mapped model file claims against its size, so that no view can reach past the mapping.
+ **/
+static char solver_model_check(const SolverModelHeader *header, const SolverModelLayer *entries, size_t size){
+    const size_t eSize = header->type == MATRIX_FLOAT32 ? sizeof(float) : sizeof(double);
+    uint32_t i, prev;
+    
+    if(memcmp(header->magic, SOLVER_MODEL_MAGIC, sizeof(header->magic)) || header->byte_order != SOLVER_MODEL_BYTE_ORDER) return 0;
+    if(header->version != SOLVER_MODEL_VERSION){
+        fprintf(stderr, "Model file version %u, only version %d is known.\n", header->version, SOLVER_MODEL_VERSION);
+        return 0;
+    }
+    if((header->type != MATRIX_FLOAT64 && header->type != MATRIX_FLOAT32) || header->input_size < 1 || header->layers < 1) return 0;
+    if(header->layers > (size - sizeof(SolverModelHeader)) / sizeof(SolverModelLayer)) return 0;
+    if(header->params_offset % SOLVER_MODEL_ALIGN || header->params_offset > size || header->params_size < 1 || header->params_size > INT32_MAX) return 0;
+    if(header->params_size > (size - header->params_offset) / eSize) return 0;
+    
+    for(i = 0, prev = header->input_size; i < header->layers; prev = entries[i++].n){
+        if(entries[i].m != prev || entries[i].n < 1 || entries[i].n > INT32_MAX) return 0;
+        if(entries[i].activation != ACTIV_FUNC_SIGMOID && entries[i].activation != ACTIV_FUNC_RELU) return 0;
+    }
+    
+    return 1;
+}
+
+NeuralNetworkSolver *solver_load(char *filename){
+    if(filename == NULL) return NULL;
+    
+    const int fd = open(filename, O_RDONLY);
+    struct stat info;
+    
+    if(fd < 0 || fstat(fd, &info) || (size_t) info.st_size < sizeof(SolverModelHeader)){
+        fprintf(stderr, "Error in solver_load. Can't read a model from %s.\n", filename);
+        if(fd >= 0) close(fd);
+        return NULL;
+    }
+    
+    //Shared and read only: every process mapping the file reads the same pages
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED){
+        fprintf(stderr, "Error in solver_load. Can't map %s.\n", filename);
+        return NULL;
+    }
+    
+    const SolverModelHeader *header = (const SolverModelHeader *) mapping;
+    const SolverModelLayer *entries = (const SolverModelLayer *) (header + 1);
+    
+    if(!solver_model_check(header, entries, info.st_size)){
+        fprintf(stderr, "Error in solver_load. %s isn't a valid model file.\n", filename);
+        munmap(mapping, info.st_size);
+        return NULL;
+    }
+    
+    NeuralNetworkSolver *ret = generic_neural_network_solver_create(0, 0);
+    NeuralNetworkHiddenSolver *h_solver = ret->hidden_solver;
+    Generic_Neural_Layer *layer;
+    uint32_t i;
+    
+    ret->add_input_layer = generic_add_input_layer;
+    ret->add_hidden_layer = generic_add_hidden_layer;
+    ret->add_output_layer = generic_add_output_layer;
+    ret->forwardPropagate = neural_network_forward_propagate;
+    ret->backPropagate = neural_network_back_propagate;
+    
+    h_solver->frozen = 1;
+    h_solver->mapping = mapping;
+    h_solver->mapping_size = info.st_size;
+    h_solver->type = (char) header->type;
+    h_solver->input_size = header->input_size;
+    h_solver->layers = generic_init_layers();
+    h_solver->params = matrixViewMemory((char *) mapping + header->params_offset, 1, (int) header->params_size, h_solver->type);
+    assert(h_solver->layers != NULL && h_solver->params != NULL);
+    
+    for(i = 0; i < header->layers; i++){
+        layer = (Generic_Neural_Layer *) calloc(1, sizeof(Generic_Neural_Layer));
+        assert(layer != NULL);
+        listAppend(h_solver->layers, &layer);
+        
+        //matrixViewArena() refuses offsets that are misaligned or run past the arena
+        layer->w = matrixViewArena(h_solver->params, entries[i].w_offset, entries[i].n, entries[i].m);
+        layer->b = matrixViewArena(h_solver->params, entries[i].b_offset, entries[i].n, 1);
+        if(layer->w == NULL || layer->b == NULL){
+            fprintf(stderr, "Error in solver_load. Layer %u of %s lies outside of its parameters.\n", i + 1, filename);
+            solver_destroy(ret);
+            return NULL;
+        }
+        
+        activ_fun_set_fun(&(layer->activation_function), &(layer->d_activation_function), entries[i].activation);
+        layer->activation_flag = entries[i].activation;
+    }
+    
+    return ret;
+}
+
+
 /**
  * Stochastic Gradient Descent
  **/
@@ -250,31 +1341,77 @@ void sgd_create_layer(NeuralNetworkSolver *solver, int size, int activation_func
 void sgd_step_forward(void *fl, Matrix **a){
     SGD_Neural_Layer *flayer = (SGD_Neural_Layer *) fl;
     
-    matrixMul(flayer->super.w, *a, flayer->super.z, 0);
+    //z = w * a + b and a = activation(z) in a single pass over the output (z is kept for the backward pass)
+    matrixMulBiasActivate(flayer->super.w, *a, flayer->super.b, flayer->super.z, flayer->super.a, flayer->super.activation_flag);
     *a = flayer->super.a;
-    matrixAdd(flayer->super.b, flayer->super.z, flayer->super.z, 0);
-    flayer->super.activation_function(flayer->super.z, *a);
 }
 
 void sgd_dz_solver(void *fl){
     SGD_Neural_Layer *flayer = (SGD_Neural_Layer *) fl;
     
-    Matrix * dadz = flayer->super.d_activation_function(flayer->super.z, flayer->super.a);
-    matrixMul(dadz, flayer->super.da, flayer->super.dz, 0);
-    matrixDestroy(dadz, 0);
+    flayer->super.d_activation_function(flayer->super.z, flayer->super.a, flayer->super.da, flayer->super.dz);
 }
 
 void sgd_da_solver(void *fl, void *bl){
     matrixMul(((SGD_Neural_Layer *) fl)->super.w, ((SGD_Neural_Layer *) fl)->super.dz, ((SGD_Neural_Layer *) bl)->super.da, MATRIX_A_TRANS);
 }
 
-void sgd_dw_dz_solver(void *fl, void *bl, double rate){
+void sgd_dw_dz_solver(NeuralNetworkHiddenSolver *h_solver, void *fl, void *bl, int columns){
     SGD_Neural_Layer *flayer = (SGD_Neural_Layer *) fl;
     
-    matrixConstantMul(flayer->super.dz, rate);
+    matrixConstantMul(flayer->super.dz, h_solver->rate / columns);
     
+    //w += dz * a^T sums the per-sample outer products, and b gets the sum of dz's columns
     matrixMul(flayer->super.dz, ((SGD_Neural_Layer *) bl)->super.a, flayer->super.w, MATRIX_B_TRANS | MATRIX_RESULT_ADD);
-    matrixAdd(flayer->super.b, flayer->super.dz, flayer->super.b, 0);
+    matrixReduceCols(flayer->super.dz, flayer->super.b, MATRIX_RESULT_ADD);
+}
+
+//Largest share of a batch's inputs that are non-zero for which the first layer is updated one column at a time
+#define SOLVER_SPARSE_DENSITY 0.25
+
+/**
+ * SGD's update for Hogwild workers. An input that is zero in every sample of the batch leaves its column of the first
+ * layer's w unchanged, so for sparse batches only the other columns are written: w[:,k] += dz * x[k,:]^T. Workers then
+ * only collide on the inputs their batches share, instead of every one of them rewriting all of w with old + 0.
+ * Later layers (whose inputs are dense activations) and b are updated whole, as sgd_dw_dz_solver() does.
+ **/
+void sgd_sparse_dw_db_solver(NeuralNetworkHiddenSolver *h_solver, void *fl, void *bl, int columns){
+    Generic_Neural_Layer *flayer = (Generic_Neural_Layer *) fl;
+    Matrix *x = ((Generic_Neural_Layer *) bl)->a;
+    
+    if(fl != LIST_DER(void *, listGet(h_solver->layers, 0))){
+        sgd_dw_dz_solver(h_solver, fl, bl, columns);
+        return;
+    }
+    
+    const int n = matrixGetN(flayer->w), m = matrixGetM(flayer->w), c = matrixGetM(x);
+    int i, k, active;
+    
+    if(h_solver->sparse_rows == NULL){
+        h_solver->sparse_rows = (int *) malloc(m * sizeof(int));
+        if(h_solver->sparse_rows == NULL){
+            printf("Error in sparse update. Insufficient space. Exiting.\n");
+            exit(0);
+        }
+    }
+    
+    active = matrixNonZeroRows(x, h_solver->sparse_rows);
+    if(active > SOLVER_SPARSE_DENSITY * m){
+        sgd_dw_dz_solver(h_solver, fl, bl, columns);
+        return;
+    }
+    
+    matrixConstantMul(flayer->dz, h_solver->rate / columns);
+    
+    for(i = 0; i < active; i++){
+        k = h_solver->sparse_rows[i];
+        h_solver->sparse_w = h_solver->sparse_w == NULL ? matrixView(flayer->w, 0, k, n, 1) : matrixViewMove(h_solver->sparse_w, flayer->w, 0, k, n, 1);
+        h_solver->sparse_x = h_solver->sparse_x == NULL ? matrixView(x, k, 0, 1, c) : matrixViewMove(h_solver->sparse_x, x, k, 0, 1, c);
+        assert(h_solver->sparse_w != NULL && h_solver->sparse_x != NULL);
+        
+        matrixMul(flayer->dz, h_solver->sparse_x, h_solver->sparse_w, MATRIX_B_TRANS | MATRIX_RESULT_ADD);
+    }
+    matrixReduceCols(flayer->dz, flayer->b, MATRIX_RESULT_ADD);
 }
 
 void sgd_d_cost(void *bl, Matrix *y){
@@ -283,6 +1420,7 @@ void sgd_d_cost(void *bl, Matrix *y){
 
 NeuralNetworkSolver *neural_network_solver_sgd(double alpha, double rate){
     NeuralNetworkSolver *ret = generic_neural_network_solver_create(alpha, rate);
+    if(ret == NULL) return NULL;
     //I don't really need dW, dZ, or dB directly. Maybe I should delete them?
     
     //Set the solver functions here to keep the functions unique at each instance
@@ -310,6 +1448,86 @@ NeuralNetworkSolver *neural_network_solver_sgd(double alpha, double rate){
     return ret;
 }
 
+
+/**
+ * Momentum, RMSProp and Adam
+ *
+ * These share SGD's layers, forward pass and gradients. The averaged gradient goes into dw and db, and once the whole
+ * network is done a single fused pass over the parameter arena updates every w and b together with the moments.
+ **/
+
+//Keeps the RMSProp and Adam steps finite while the mean square is still (near) zero
+#define SOLVER_EPSILON 1e-8
+
+/**
+ * dw = dz * a^T / columns and db = sum of dz's columns / columns (both pointing downhill, like SGD's update).
+ **/
+void moment_dw_db_solver(NeuralNetworkHiddenSolver *h_solver, void *fl, void *bl, int columns){
+    Generic_Neural_Layer *flayer = (Generic_Neural_Layer *) fl;
+    (void) h_solver;
+    
+    matrixConstantMul(flayer->dz, 1.0 / columns);
+    
+    matrixMul(flayer->dz, ((Generic_Neural_Layer *) bl)->a, flayer->dw, MATRIX_B_TRANS);
+    matrixReduceCols(flayer->dz, flayer->db, 0);
+}
+
+//What the updates write: the parameters themselves, or the master weights and their float shadow (the parameters) in mixed precision
+#define SOLVER_UPDATE_WEIGHTS(H_SOLVER) ((H_SOLVER)->weights != NULL ? (H_SOLVER)->weights : (H_SOLVER)->params)
+#define SOLVER_UPDATE_SHADOW(H_SOLVER) ((H_SOLVER)->weights != NULL ? (H_SOLVER)->params : NULL)
+
+void sgd_update(NeuralNetworkHiddenSolver *h_solver, Matrix *grads){
+    matrixSGDUpdate(SOLVER_UPDATE_WEIGHTS(h_solver), grads, h_solver->rate, SOLVER_UPDATE_SHADOW(h_solver));
+}
+
+void momentum_update(NeuralNetworkHiddenSolver *h_solver, Matrix *grads){
+    matrixMomentumUpdate(SOLVER_UPDATE_WEIGHTS(h_solver), h_solver->moments[0], grads, h_solver->alpha, h_solver->rate, SOLVER_UPDATE_SHADOW(h_solver));
+}
+
+void rmsprop_update(NeuralNetworkHiddenSolver *h_solver, Matrix *grads){
+    matrixRMSPropUpdate(SOLVER_UPDATE_WEIGHTS(h_solver), h_solver->moments[1], grads, h_solver->alpha, h_solver->rate, SOLVER_EPSILON, SOLVER_UPDATE_SHADOW(h_solver));
+}
+
+void adam_update(NeuralNetworkHiddenSolver *h_solver, Matrix *grads){
+    matrixAdamUpdate(SOLVER_UPDATE_WEIGHTS(h_solver), h_solver->moments[0], h_solver->moments[1], grads, h_solver->alpha, h_solver->beta, h_solver->rate,
+                     SOLVER_EPSILON, h_solver->steps, SOLVER_UPDATE_SHADOW(h_solver));
+}
+
+/**
+ * SGD's solver with its weight update swapped for a sweep over the arenas keeping the given SOLVER_STATE_* moments.
+ **/
+static NeuralNetworkSolver *moment_solver_create(double alpha, double rate, char state, void (*update)(NeuralNetworkHiddenSolver *, Matrix *)){
+    NeuralNetworkSolver *ret = neural_network_solver_sgd(alpha, rate);
+    if(ret == NULL) return NULL;
+    
+    ret->hidden_solver->state = state;
+    ret->hidden_solver->dw_db_solver = moment_dw_db_solver;
+    ret->hidden_solver->update = update;
+    
+    return ret;
+}
+
+NeuralNetworkSolver *neural_network_solver_momentum(double alpha, double rate){
+    return moment_solver_create(alpha, rate, SOLVER_STATE_MEAN, momentum_update);
+}
+
+NeuralNetworkSolver *neural_network_solver_rmsprop(double alpha, double rate){
+    //The mean square never leaves 0 with a decay of 1
+    if(alpha >= 1.0) return NULL;
+    
+    return moment_solver_create(alpha, rate, SOLVER_STATE_SQUARE, rmsprop_update);
+}
+
+NeuralNetworkSolver *neural_network_solver_adam(double alpha, double beta, double rate){
+    //The bias corrections divide by 1 - alpha^step and 1 - beta^step
+    if(alpha >= 1.0 || beta < 0 || beta >= 1.0) return NULL;
+    
+    NeuralNetworkSolver *ret = moment_solver_create(alpha, rate, SOLVER_STATE_MEAN | SOLVER_STATE_SQUARE, adam_update);
+    if(ret != NULL) ret->hidden_solver->beta = beta;
+    
+    return ret;
+}
+
     /*
 void sgd_forwardPropagate(NeuralNetworkSolver *solver, Matrix *input){
     if(input == NULL || !solver_check_valid(solver)) return;
@@ -3,11 +3,17 @@
 #include <math.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include "libremodel.h"
+#include "components/thread_pool.h"
 #include "neural_network/components/activ_func.h"
 #include "neural_network/components/solver.h"
+#include "neural_network/components/checkpoint.h"
 #include "neural_network/neural.h"
 
+//Samples run through the network at once when classifying a list
+#define NEURAL_INFERENCE_COLUMNS 256
+
 char solver_check_valid(NeuralNetworkSolver *solver){
     return solver != NULL;
 }
@@ -26,9 +32,11 @@ char check_matrix_list(List *m, int expected_n, int expected_m){
     return 1;
 }
 
-int neural_list_get_random(List *donor, List *dropoff){
-    int index = rand() % listGetSize(donor);
-    int num = LIST_DER(int, listRemoveRet(donor, index));
+int neural_list_get_random(List *donor, List *dropoff, unsigned int *state){
+    int index = rand_r(state) % listGetSize(donor);
+    int *removed = (int *) listRemoveRet(donor, index);
+    int num = *removed;
+    free(removed);
     listAppend(dropoff, &num);
     return num;    
 }
@@ -44,11 +52,12 @@ void neural_layers_destroy(void *layers){
     }
 }
 
-NeuralNetwork *neural_network_create(NeuralNetworkSolver *solver, char file_flag, char *filename, int seed){
-    if(!solver_check_valid(solver) || (file_flag && filename == NULL)) return NULL;
+/**
+ * A network with the default settings around solver, or NULL if solver can't be used.
+ **/
+static NeuralNetwork *neural_network_alloc(NeuralNetworkSolver *solver){
     NeuralNetwork *network = (NeuralNetwork *) calloc(1, sizeof(NeuralNetwork));
     assert(network != NULL);
-    srandom(seed);
     
     neural_network_set_solver(solver, network);
     if(!solver_check_valid(network->solver)){
@@ -56,6 +65,22 @@ NeuralNetwork *neural_network_create(NeuralNetworkSolver *solver, char file_flag
         neural_network_destroy(network);
         return NULL;
     }
+    
+    network->batch_size = 1;
+    network->max_epochs = 100;
+    network->parallel = NEURAL_PARALLEL_NONE;
+    
+    return network;
+}
+
+NeuralNetwork *neural_network_create(NeuralNetworkSolver *solver, char file_flag, char *filename, int seed){
+    if(!solver_check_valid(solver) || (file_flag && filename == NULL)) return NULL;
+    
+    NeuralNetwork *network = neural_network_alloc(solver);
+    if(network == NULL) return NULL;
+    
+    solver_set_seed(network->solver, (unsigned long) seed);
+    network->shuffle = (unsigned int) seed;
     /*activ_fun_set_fun(network, activation_function_flag);
     if(network->activation_function == NULL || network->d_activation_function == NULL){
         printf("Error in setting activation functions. Destroying network.\n");
@@ -74,6 +99,45 @@ NeuralNetwork *neural_network_create(NeuralNetworkSolver *solver, char file_flag
     
     return network;
 }
+
+void neural_network_freeze(NeuralNetwork *network){
+    if(network == NULL) return;
+    
+    solver_freeze(network->solver);
+}
+
+char neural_network_save(NeuralNetwork *network, char *filename){
+    if(network == NULL || filename == NULL) return 0;
+    
+    //Written next to the target and renamed over it, so a process mapping the old file never sees a partial one
+    char *temp = (char *) malloc(strlen(filename) + 5);
+    assert(temp != NULL);
+    sprintf(temp, "%s.tmp", filename);
+    
+    FILE *file = fopen(temp, "wb");
+    char ret = file != NULL && solver_save(network->solver, file);
+    
+    if(file != NULL && fclose(file)) ret = 0;
+    if(ret && rename(temp, filename)) ret = 0;
+    if(!ret){
+        printf("Unable to save the network to %s.\n", filename);
+        remove(temp);
+    }
+    
+    free(temp);
+    return ret;
+}
+
+NeuralNetwork *neural_network_load(char *filename){
+    NeuralNetworkSolver *solver = solver_load(filename);
+    if(solver == NULL) return NULL;
+    
+    NeuralNetwork *network = neural_network_alloc(solver);
+    if(network == NULL) solver_destroy(solver);
+    
+    return network;
+}
+
 void neural_network_destroy(NeuralNetwork *network){
     if(network == NULL) return;
     
@@ -81,8 +145,12 @@ void neural_network_destroy(NeuralNetwork *network){
         fclose(network->logFile);
     }
     
+    //The inference buffers are sized from the solver's layers, so they go first
+    neural_context_destroy(network->context);
+    free(network->checkpoint);
+    
     if(solver_check_valid(network->solver)){
-        //TODO:Create destroyer for this later
+        solver_destroy(network->solver);
     }
     
     free(network);
@@ -98,6 +166,7 @@ char neural_network_add_input_layer(NeuralNetwork *network, int size){
 
 char neural_network_add_hidden_layer(NeuralNetwork *network, int size, int activation_function_flag){
     if(size < 1 || network == NULL || solver_get_num_layers(network->solver) < 1) return 0; //Cannot be first so size must not be 0
+    if(solver_is_frozen(network->solver)) return 0;
     
     network->solver->add_hidden_layer(network->solver, size, activation_function_flag);
     
@@ -108,6 +177,677 @@ char neural_network_add_output_layer(NeuralNetwork *network, int size){
     return neural_network_add_hidden_layer(network, size, ACTIV_FUNC_SIGMOID); //Did this for now.. If anything results in being different on the output layer, I'll add it.
 }
 
+void neural_network_set_batch_size(NeuralNetwork *network, int batch_size){
+    if(network == NULL || batch_size < 1) return;
+    
+    network->batch_size = batch_size;
+    solver_set_batch_size(network->solver, batch_size);
+}
+
+/**
+ * Matrix with one column per sample of a batch, plus views of each column to copy samples into
+ * and a view of the first rest columns for the smaller batch at the end of an epoch.
+ **/
+typedef struct{
+    Matrix *full, *rest;
+    Matrix **cols;
+} Neural_Batch;
+
+static void neural_batch_create(Neural_Batch *batch, Matrix *sample, int batch_size, int rest){
+    const int n = matrixGetN(sample);
+    int i;
+    
+    batch->full = matrixGetType(sample) == MATRIX_FLOAT32 ? matrixCreateF(n, batch_size, NULL, n * batch_size) : matrixCreate(n, batch_size, NULL, n * batch_size);
+    batch->cols = (Matrix **) calloc(batch_size, sizeof(Matrix *));
+    assert(batch->full != NULL && batch->cols != NULL);
+    
+    for(i = 0; i < batch_size; i++){
+        batch->cols[i] = matrixView(batch->full, 0, i, n, 1);
+    }
+    batch->rest = rest ? matrixView(batch->full, 0, 0, n, rest) : NULL;
+}
+
+static void neural_batch_destroy(Neural_Batch *batch, int batch_size){
+    int i;
+    
+    for(i = 0; i < batch_size; i++){
+        matrixDestroy(batch->cols[i], 0);
+    }
+    free(batch->cols);
+    matrixDestroy(batch->rest, 0);
+    matrixDestroy(batch->full, 0);
+}
+
+/**
+ * Points *x_mat and *y_mat at the count samples listed in indexes: the lone sample itself when batch_size is 1,
+ * otherwise the batch matrices after copying the samples into their columns.
+ **/
+static void neural_batch_gather(Neural_Batch *x_batch, Neural_Batch *y_batch, List *x, List *y, const int *indexes, int count, int batch_size, Matrix **x_mat, Matrix **y_mat){
+    int k;
+    
+    if(batch_size == 1){
+        *x_mat = LIST_DER(Matrix *, listGet(x, indexes[0]));
+        *y_mat = LIST_DER(Matrix *, listGet(y, indexes[0]));
+        return;
+    }
+    
+    for(k = 0; k < count; k++){
+        matrixConvert(LIST_DER(Matrix *, listGet(x, indexes[k])), x_batch->cols[k], matrixGetType(x_batch->full));
+        matrixConvert(LIST_DER(Matrix *, listGet(y, indexes[k])), y_batch->cols[k], matrixGetType(y_batch->full));
+    }
+    *x_mat = count == batch_size ? x_batch->full : x_batch->rest;
+    *y_mat = count == batch_size ? y_batch->full : y_batch->rest;
+}
+
+void neural_network_set_max_epochs(NeuralNetwork *network, int epochs){
+    if(network == NULL || epochs < 1) return;
+    
+    network->max_epochs = epochs;
+}
+
+void neural_network_set_early_stopping(NeuralNetwork *network, List *x, List *y, double tolerance, int patience){
+    if(network == NULL || tolerance < 0) return;
+    if(x != NULL && (y == NULL || listGetSize(x) != listGetSize(y) || listGetSize(x) == 0)){
+        printf("Validation samples and labels don't match. Ignoring.\n");
+        return;
+    }
+    
+    network->valid_x = x;
+    network->valid_y = y;
+    network->tolerance = tolerance;
+    network->patience = patience;
+}
+
+/**
+ * Mean (over samples) of the squared error summed over outputs, on the validation set run through the network in batches.
+ * indexes is 0, 1, 2... up to the validation set's size.
+ **/
+static double neural_validation_loss(NeuralNetwork *network, Neural_Batch *x_batch, Neural_Batch *y_batch, const int *indexes, int batch_size){
+    const int list_size = listGetSize(network->valid_x);
+    double loss = 0;
+    int i, r, c;
+    
+    for(i = 0; i < list_size; i += batch_size){
+        const int count = list_size - i < batch_size ? list_size - i : batch_size;
+        Matrix *x_mat, *y_mat;
+        
+        neural_batch_gather(x_batch, y_batch, network->valid_x, network->valid_y, indexes + i, count, batch_size, &x_mat, &y_mat);
+        network->solver->forwardPropagate(network->solver, x_mat);
+        
+        Matrix *output = solver_get_output_layer(network->solver);
+        for(r = 0; r < matrixGetN(y_mat); r++){
+            for(c = 0; c < count; c++){
+                const double diff = matrixGetValue(output, r, c) - matrixGetValue(y_mat, r, c);
+                loss += diff * diff;
+            }
+        }
+    }
+    
+    //Ranks training together stop together
+    return solver_allreduce_value(network->solver, loss / list_size);
+}
+
+void neural_network_set_checkpoint(NeuralNetwork *network, char *filename, int period, char unit){
+    if(network == NULL || (filename != NULL && (period < 1 || (unit != NEURAL_CHECKPOINT_EPOCHS && unit != NEURAL_CHECKPOINT_SAMPLES)))) return;
+    
+    free(network->checkpoint);
+    network->checkpoint = NULL;
+    if(filename != NULL){
+        network->checkpoint = strdup(filename);
+        assert(network->checkpoint != NULL);
+    }
+    network->checkpoint_period = period;
+    network->checkpoint_unit = unit;
+}
+
+/**
+ * Hands a snapshot of the training state to the checkpoint writer, having trained on position samples of the round after epoch.
+ **/
+static void neural_checkpoint(NeuralNetwork *network, NeuralCheckpointWriter *writer, const int *order, int samples, int epoch, int position, Matrix *best, double best_loss, int stale){
+    NeuralCheckpoint *snapshot = checkpoint_writer_acquire(writer);
+    int i;
+    
+    //Copies into the snapshot's own buffers, made on its first use, so training only waits for memory
+    snapshot->params = solver_copy_parameters(network->solver, snapshot->params);
+    for(i = 0; i < 2; i++){
+        snapshot->moments[i] = solver_copy_moment(network->solver, i, snapshot->moments[i]);
+    }
+    if(best != NULL){
+        snapshot->best = matrixConvert(best, snapshot->best, matrixGetType(best));
+    }else if(snapshot->best != NULL){
+        matrixDestroy(snapshot->best, 0);
+        snapshot->best = NULL;
+    }
+    if(snapshot->order == NULL){
+        snapshot->order = (int *) malloc(samples * sizeof(int));
+        assert(snapshot->order != NULL);
+    }
+    memcpy(snapshot->order, order, samples * sizeof(int));
+    
+    snapshot->steps = solver_get_steps(network->solver);
+    snapshot->best_loss = best_loss;
+    snapshot->samples = samples;
+    snapshot->epoch = epoch;
+    snapshot->position = position;
+    snapshot->stale = stale;
+    snapshot->shuffle = network->shuffle;
+    
+    checkpoint_writer_submit(writer);
+}
+
+char neural_network_resume(NeuralNetwork *network, char *filename, List *x, List *y){
+    if(network == NULL || filename == NULL || x == NULL || solver_is_frozen(network->solver)) return 0;
+    
+    NeuralCheckpoint *checkpoint = (NeuralCheckpoint *) calloc(1, sizeof(NeuralCheckpoint));
+    assert(checkpoint != NULL);
+    
+    if(!checkpoint_read(checkpoint, filename)){
+        free(checkpoint);
+        return 0;
+    }
+    if(checkpoint->samples != listGetSize(x) || solver_get_parameters(network->solver) == NULL || matrixGetM(checkpoint->params) != matrixGetM(solver_get_parameters(network->solver))){
+        printf("Checkpoint %s was made for another network or training set. Not resuming.\n", filename);
+        checkpoint_clear(checkpoint);
+        free(checkpoint);
+        return 0;
+    }
+    
+    int i;
+    
+    //Moments left at zero while the steps carry on would throw off Adam's bias correction
+    for(i = 0; i < 2; i++){
+        if((checkpoint->moments[i] != NULL) != solver_has_moment(network->solver, i)){
+            printf("Checkpoint %s was made with another solver. Not resuming.\n", filename);
+            checkpoint_clear(checkpoint);
+            free(checkpoint);
+            return 0;
+        }
+    }
+    
+    solver_restore_parameters(network->solver, checkpoint->params);
+    for(i = 0; i < 2; i++){
+        solver_restore_moment(network->solver, i, checkpoint->moments[i]);
+    }
+    solver_set_steps(network->solver, checkpoint->steps);
+    
+    //Training picks the rest (round, sample order, early stopping) up from it
+    network->resume = checkpoint;
+    neural_network_train(network, x, y);
+    
+    //Still there if training turned x and y down
+    const char ret = network->resume == NULL;
+    if(!ret){
+        checkpoint_clear(network->resume);
+        free(network->resume);
+        network->resume = NULL;
+    }
+    
+    return ret;
+}
+
+void neural_network_set_parallel(NeuralNetwork *network, char mode, int workers){
+    if(network == NULL || mode < NEURAL_PARALLEL_NONE || mode > NEURAL_PARALLEL_PIPELINE) return;
+    
+    network->parallel = mode;
+    network->workers = workers;
+}
+
+void neural_network_set_allreduce(NeuralNetwork *network, Allreduce *comm, char mode, int period){
+    if(network == NULL || (comm != NULL && mode != NEURAL_ALLREDUCE_GRADIENTS && mode != NEURAL_ALLREDUCE_PARAMETERS)) return;
+    
+    solver_set_allreduce(network->solver, comm, mode, period);
+}
+
+void neural_network_set_profiling(NeuralNetwork *network, char enabled){
+    if(network == NULL) return;
+    
+    solver_set_profiling(network->solver, enabled);
+}
+
+char neural_network_get_profile(NeuralNetwork *network, int layer, int kernel, NeuralProfile *profile){
+    if(network == NULL) return 0;
+    
+    return solver_get_profile(network->solver, layer, kernel, profile);
+}
+
+void neural_network_print_profile(NeuralNetwork *network, FILE *output){
+    static const char *names[NEURAL_PROFILE_KERNELS] = {"forward", "dz", "da", "dw_db", "update"};
+    NeuralProfile profile, total;
+    int layer, kernel;
+    
+    if(network == NULL || output == NULL || !neural_network_get_profile(network, 0, NEURAL_PROFILE_UPDATE, &total)) return;
+    
+    //The whole network's time, for each kernel's share
+    for(kernel = 0; kernel < NEURAL_PROFILE_UPDATE; kernel++){
+        neural_network_get_profile(network, 0, kernel, &profile);
+        total.seconds += profile.seconds;
+    }
+    
+    fprintf(output, "%-7s %-8s %10s %12s %7s %10s %10s\n", "Layer", "Kernel", "Calls", "Seconds", "Share", "GFLOP/s", "GB/s");
+    for(layer = 1; neural_network_get_profile(network, layer, 0, &profile); layer++){
+        for(kernel = 0; kernel < NEURAL_PROFILE_UPDATE; kernel++){
+            neural_network_get_profile(network, layer, kernel, &profile);
+            if(!profile.calls) continue;
+            
+            fprintf(output, "%-7d %-8s %10ld %12.6f %6.2f%% %10.3f %10.3f\n", layer, names[kernel], profile.calls, profile.seconds,
+                total.seconds > 0 ? 100 * profile.seconds / total.seconds : 0,
+                profile.seconds > 0 ? profile.flops / profile.seconds * 1e-9 : 0,
+                profile.seconds > 0 ? profile.bytes / profile.seconds * 1e-9 : 0);
+        }
+    }
+    
+    for(kernel = 0; kernel < NEURAL_PROFILE_KERNELS; kernel++){
+        neural_network_get_profile(network, 0, kernel, &profile);
+        if(!profile.calls) continue;
+        
+        fprintf(output, "%-7s %-8s %10ld %12.6f %6.2f%% %10.3f %10.3f\n", "All", names[kernel], profile.calls, profile.seconds,
+            total.seconds > 0 ? 100 * profile.seconds / total.seconds : 0,
+            profile.seconds > 0 ? profile.flops / profile.seconds * 1e-9 : 0,
+            profile.seconds > 0 ? profile.bytes / profile.seconds * 1e-9 : 0);
+    }
+}
+
+/**
+ * A training thread's own solver replica and batch buffers, plus the slice [from, to) of each epoch's sample order it trains on (Hogwild only).
+ **/
+typedef struct{
+    NeuralNetworkSolver *solver;
+    Neural_Batch x_batch, y_batch;
+    int from, to;
+} Neural_Worker;
+
+typedef struct{
+    Neural_Worker *workers;
+    List *x, *y;
+    const int *order;
+    int batch_size;
+} Neural_Epoch;
+
+static Neural_Worker *neural_workers_create(NeuralNetwork *network, List *x, List *y, int count, int batch_size){
+    Neural_Worker *workers = (Neural_Worker *) calloc(count, sizeof(Neural_Worker));
+    assert(workers != NULL);
+    
+    const int list_size = listGetSize(x);
+    int i;
+    
+    for(i = 0; i < count; i++){
+        workers[i].solver = solver_replica_create(network->solver, network->parallel == NEURAL_PARALLEL_DATA ? SOLVER_REPLICA_GRADIENTS : SOLVER_REPLICA_SHARED);
+        assert(workers[i].solver != NULL);
+        workers[i].from = (int) (((long) list_size * i) / count);
+        workers[i].to = (int) (((long) list_size * (i + 1)) / count);
+        
+        //Data parallel workers read their shard straight out of the shared batch
+        if(batch_size > 1 && network->parallel == NEURAL_PARALLEL_HOGWILD){
+            const int rest = (workers[i].to - workers[i].from) % batch_size;
+            neural_batch_create(&workers[i].x_batch, LIST_DER(Matrix *, listGet(x, 0)), batch_size, rest);
+            neural_batch_create(&workers[i].y_batch, LIST_DER(Matrix *, listGet(y, 0)), batch_size, rest);
+        }
+    }
+    
+    return workers;
+}
+
+static void neural_workers_destroy(Neural_Worker *workers, int count, int batch_size){
+    int i;
+    
+    for(i = 0; i < count; i++){
+        if(workers[i].x_batch.full != NULL){
+            neural_batch_destroy(&workers[i].x_batch, batch_size);
+            neural_batch_destroy(&workers[i].y_batch, batch_size);
+        }
+        solver_destroy(workers[i].solver);
+    }
+    free(workers);
+}
+
+/**
+ * Hogwild!: each worker trains on its slice of the epoch with its own activations and gradients, updating the shared w and b
+ * without any locking, so updates that collide may be partly lost. With SGD a worker only writes the first layer's columns
+ * of the inputs its batch has, so sparse inputs keep those collisions rare; every other layer, and the whole arena of the
+ * moment-based optimizers (and of mixed precision), is rewritten by every worker on every step.
+ **/
+static void neural_hogwild_part(void *arg, int start, int end){
+    Neural_Epoch *epoch = (Neural_Epoch *) arg;
+    const int batch_size = epoch->batch_size;
+    Matrix *x_mat, *y_mat;
+    int w, i;
+    
+    for(w = start; w < end; w++){
+        Neural_Worker *worker = epoch->workers + w;
+        
+        for(i = worker->from; i < worker->to; i += batch_size){
+            const int count = worker->to - i < batch_size ? worker->to - i : batch_size;
+            
+            neural_batch_gather(&worker->x_batch, &worker->y_batch, epoch->x, epoch->y, epoch->order + i, count, batch_size, &x_mat, &y_mat);
+            worker->solver->forwardPropagate(worker->solver, x_mat);
+            worker->solver->backPropagate(worker->solver, x_mat, y_mat);
+        }
+    }
+}
+
+/**
+ * One synchronous data parallel step: the columns of the batch are split into contiguous shards, one per worker.
+ **/
+typedef struct{
+    Neural_Worker *workers;
+    Matrix *x, *y;
+    int shards;
+} Neural_Data_Step;
+
+static void neural_data_part(void *arg, int start, int end){
+    Neural_Data_Step *step = (Neural_Data_Step *) arg;
+    const int columns = matrixGetM(step->x);
+    int w;
+    
+    for(w = start; w < end; w++){
+        NeuralNetworkSolver *solver = step->workers[w].solver;
+        const int from = (int) (((long) columns * w) / step->shards);
+        const int to = (int) (((long) columns * (w + 1)) / step->shards);
+        Matrix *x_shard = step->shards == 1 ? step->x : matrixView(step->x, 0, from, matrixGetN(step->x), to - from);
+        Matrix *y_shard = step->shards == 1 ? step->y : matrixView(step->y, 0, from, matrixGetN(step->y), to - from);
+        
+        //Leaves the shard's summed gradients in the worker's dw and db
+        solver->forwardPropagate(solver, x_shard);
+        solver->backPropagate(solver, x_shard, y_shard);
+        
+        if(step->shards != 1){
+            matrixDestroy(x_shard, 0);
+            matrixDestroy(y_shard, 0);
+        }
+    }
+}
+
+typedef struct{
+    Neural_Worker *workers;
+    int stride;
+} Neural_Reduce_Level;
+
+static void neural_reduce_part(void *arg, int start, int end){
+    Neural_Reduce_Level *level = (Neural_Reduce_Level *) arg;
+    int pair;
+    
+    for(pair = start; pair < end; pair++){
+        const int i = pair * 2 * level->stride;
+        Matrix *sum = solver_get_gradients(level->workers[i].solver);
+        matrixAdd(sum, solver_get_gradients(level->workers[i + level->stride].solver), sum, 0);
+    }
+}
+
+/**
+ * Adds the gradient arenas of the first count workers up into the first one's, pairwise along a fixed binary tree.
+ * The additions (and so the rounding) are the same whatever threads run them, which keeps the result bitwise reproducible.
+ **/
+static Matrix *neural_gradients_reduce(Neural_Worker *workers, int count){
+    Neural_Reduce_Level level = {workers, 1};
+    
+    for(level.stride = 1; level.stride < count; level.stride *= 2){
+        const int pairs = (count - level.stride - 1) / (2 * level.stride) + 1;
+        
+        //Few but long additions are better split by matrixAdd itself
+        if(pairs >= threadPoolGetSize()){
+            threadPoolRun(neural_reduce_part, &level, pairs);
+        }else{
+            neural_reduce_part(&level, 0, pairs);
+        }
+    }
+    
+    return solver_get_gradients(workers[0].solver);
+}
+
+/**
+ * Trains on one batch with every worker computing the gradients of its shard, then applies their reduced sum as one update.
+ **/
+static void neural_data_step(NeuralNetwork *network, Neural_Worker *workers, int worker_count, Matrix *x, Matrix *y){
+    Neural_Data_Step step = {workers, x, y, 0};
+    
+    step.shards = matrixGetM(x) < worker_count ? matrixGetM(x) : worker_count;
+    threadPoolRun(neural_data_part, &step, step.shards);
+    
+    solver_apply_gradients(network->solver, neural_gradients_reduce(workers, step.shards), matrixGetM(x));
+}
+
+/**
+ * Pipeline parallel training
+ *
+ * Each stage thread owns a contiguous group of layers. A batch is cut into micro-batches, each with its own solver replica
+ * (activations of its columns only) accumulating into the solver's gradient arena. A micro-batch is passed forward from stage
+ * to stage and, once through the last one, backward again. At most one micro-batch per stage is in flight, so no queue ever
+ * fills up. The weights only change once every micro-batch of the batch is back, in one solver update.
+ **/
+
+typedef struct{
+    int micro;      /*Micro-batch, or -1 to stop the stage*/
+    char backward;
+} Neural_Message;
+
+/**
+ * Bounded FIFO of messages, one per stage (its inbox) plus one for micro-batches that are done.
+ **/
+typedef struct{
+    Neural_Message *items;
+    int capacity, head, size;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} Neural_Queue;
+
+static void neural_queue_create(Neural_Queue *queue, int capacity){
+    queue->items = (Neural_Message *) calloc(capacity, sizeof(Neural_Message));
+    assert(queue->items != NULL);
+    queue->capacity = capacity;
+    queue->head = queue->size = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+}
+
+static void neural_queue_destroy(Neural_Queue *queue){
+    free(queue->items);
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->changed);
+}
+
+static void neural_queue_push(Neural_Queue *queue, int micro, char backward){
+    pthread_mutex_lock(&queue->lock);
+    while(queue->size == queue->capacity){
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    queue->items[(queue->head + queue->size) % queue->capacity] = (Neural_Message) {micro, backward};
+    queue->size++;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static Neural_Message neural_queue_pop(Neural_Queue *queue){
+    pthread_mutex_lock(&queue->lock);
+    while(queue->size == 0){
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    Neural_Message ret = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->size--;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    
+    return ret;
+}
+
+typedef struct _neural_pipeline Neural_Pipeline;
+
+typedef struct{
+    Neural_Pipeline *pipeline;
+    int index;
+} Neural_Stage;
+
+struct _neural_pipeline{
+    NeuralNetworkSolver **micro;    /*One replica per micro-batch*/
+    Matrix **x, **y;    /*Each micro-batch's columns of the current batch*/
+    Neural_Queue *inbox;
+    Neural_Queue done;  /*Micro-batches whose backward pass went through the first layer*/
+    Neural_Stage *stages;
+    pthread_t *threads;
+    int *first;     /*Stage s owns layers [first[s], first[s + 1])*/
+    int stage_count, micro_count;
+};
+
+static void *neural_stage_run(void *arg){
+    Neural_Stage *stage = (Neural_Stage *) arg;
+    Neural_Pipeline *pipeline = stage->pipeline;
+    const int s = stage->index;
+    const int from = pipeline->first[s], to = pipeline->first[s + 1];
+    
+    for(;;){
+        Neural_Message message = neural_queue_pop(pipeline->inbox + s);
+        if(message.micro < 0) break;
+        
+        NeuralNetworkSolver *micro = pipeline->micro[message.micro];
+        
+        if(!message.backward){
+            solver_forward_range(micro, pipeline->x[message.micro], from, to);
+            
+            if(s < pipeline->stage_count - 1){
+                neural_queue_push(pipeline->inbox + s + 1, message.micro, 0);
+                continue;
+            }
+        }
+        
+        //The last stage turns straight around
+        solver_backward_range(micro, pipeline->x[message.micro], pipeline->y[message.micro], from, to);
+        neural_queue_push(s == 0 ? &pipeline->done : pipeline->inbox + s - 1, message.micro, 1);
+    }
+    
+    return NULL;
+}
+
+/**
+ * Splits the layers into stage_count contiguous groups of about the same weight count (so about the same work), at least one layer each.
+ **/
+static void neural_pipeline_partition(NeuralNetwork *network, int *first, int stage_count){
+    const int layers = solver_get_num_layers(network->solver) - 1;
+    double total = 0, prefix = 0;
+    int l, s;
+    
+    for(l = 0; l < layers; l++){
+        total += (double) solver_get_layer_n_val(network->solver, l) * solver_get_layer_n_val(network->solver, l + 1);
+    }
+    
+    first[0] = 0;
+    for(s = 1, l = 0; s < stage_count; s++){
+        do{
+            prefix += (double) solver_get_layer_n_val(network->solver, l) * solver_get_layer_n_val(network->solver, l + 1);
+            l++;
+        }while(l < layers - (stage_count - s) && prefix < total * s / stage_count);
+        first[s] = l;
+    }
+    first[stage_count] = layers;
+}
+
+static Neural_Pipeline *neural_pipeline_create(NeuralNetwork *network, int stage_count, int batch_size){
+    Neural_Pipeline *pipeline = (Neural_Pipeline *) calloc(1, sizeof(Neural_Pipeline));
+    assert(pipeline != NULL);
+    
+    const int layers = solver_get_num_layers(network->solver) - 1;
+    int i;
+    
+    if(stage_count > layers) stage_count = layers;
+    pipeline->stage_count = stage_count;
+    
+    //A few micro-batches per stage keeps the pipeline's fill and drain short compared to the batch
+    pipeline->micro_count = 4 * stage_count < batch_size ? 4 * stage_count : batch_size;
+    const int micro_size = (batch_size + pipeline->micro_count - 1) / pipeline->micro_count;
+    
+    pipeline->micro = (NeuralNetworkSolver **) calloc(pipeline->micro_count, sizeof(NeuralNetworkSolver *));
+    pipeline->x = (Matrix **) calloc(pipeline->micro_count, sizeof(Matrix *));
+    pipeline->y = (Matrix **) calloc(pipeline->micro_count, sizeof(Matrix *));
+    pipeline->inbox = (Neural_Queue *) calloc(stage_count, sizeof(Neural_Queue));
+    pipeline->stages = (Neural_Stage *) calloc(stage_count, sizeof(Neural_Stage));
+    pipeline->threads = (pthread_t *) calloc(stage_count, sizeof(pthread_t));
+    pipeline->first = (int *) calloc(stage_count + 1, sizeof(int));
+    assert(pipeline->micro != NULL && pipeline->x != NULL && pipeline->y != NULL && pipeline->inbox != NULL && pipeline->stages != NULL && pipeline->threads != NULL && pipeline->first != NULL);
+    
+    for(i = 0; i < pipeline->micro_count; i++){
+        pipeline->micro[i] = solver_replica_create(network->solver, SOLVER_REPLICA_ACCUMULATE);
+        assert(pipeline->micro[i] != NULL);
+        solver_set_batch_size(pipeline->micro[i], micro_size);
+    }
+    
+    neural_pipeline_partition(network, pipeline->first, stage_count);
+    
+    //Every queue can hold all the micro-batches in flight at once
+    neural_queue_create(&pipeline->done, stage_count);
+    for(i = 0; i < stage_count; i++){
+        neural_queue_create(pipeline->inbox + i, stage_count);
+    }
+    
+    for(i = 0; i < stage_count; i++){
+        pipeline->stages[i] = (Neural_Stage) {pipeline, i};
+        if(pthread_create(pipeline->threads + i, NULL, neural_stage_run, pipeline->stages + i)){
+            printf("Error starting pipeline stage. Exiting.\n");
+            exit(0);
+        }
+    }
+    
+    return pipeline;
+}
+
+static void neural_pipeline_destroy(Neural_Pipeline *pipeline){
+    int i;
+    
+    for(i = 0; i < pipeline->stage_count; i++){
+        neural_queue_push(pipeline->inbox + i, -1, 0);
+    }
+    for(i = 0; i < pipeline->stage_count; i++){
+        pthread_join(pipeline->threads[i], NULL);
+        neural_queue_destroy(pipeline->inbox + i);
+    }
+    neural_queue_destroy(&pipeline->done);
+    
+    for(i = 0; i < pipeline->micro_count; i++){
+        solver_destroy(pipeline->micro[i]);
+    }
+    
+    free(pipeline->micro);
+    free(pipeline->x);
+    free(pipeline->y);
+    free(pipeline->inbox);
+    free(pipeline->stages);
+    free(pipeline->threads);
+    free(pipeline->first);
+    free(pipeline);
+}
+
+/**
+ * Trains on one batch: streams its micro-batches through the stages, then applies the accumulated gradients.
+ **/
+static void neural_pipeline_step(NeuralNetwork *network, Neural_Pipeline *pipeline, Matrix *x, Matrix *y){
+    const int columns = matrixGetM(x);
+    const int micro_count = pipeline->micro_count < columns ? pipeline->micro_count : columns;
+    Matrix *grads = solver_get_gradients(network->solver);
+    int sent = 0, done = 0, i;
+    
+    for(i = 0; i < micro_count; i++){
+        const int from = (int) (((long) columns * i) / micro_count), to = (int) (((long) columns * (i + 1)) / micro_count);
+        pipeline->x[i] = matrixView(x, 0, from, matrixGetN(x), to - from);
+        pipeline->y[i] = matrixView(y, 0, from, matrixGetN(y), to - from);
+    }
+    
+    matrixSetMat(grads, 0);
+    
+    while(done < micro_count){
+        //Admit a new micro-batch whenever one has made it all the way back
+        while(sent < micro_count && sent - done < pipeline->stage_count){
+            neural_queue_push(pipeline->inbox, sent++, 0);
+        }
+        neural_queue_pop(&pipeline->done);
+        done++;
+    }
+    
+    for(i = 0; i < micro_count; i++){
+        matrixDestroy(pipeline->x[i], 0);
+        matrixDestroy(pipeline->y[i], 0);
+    }
+    
+    solver_apply_gradients(network->solver, grads, columns);
+}
+
 void neural_network_train(NeuralNetwork *network, List *x, List *y){
     //Initial checks
     if(network == NULL
@@ -117,10 +857,22 @@ void neural_network_train(NeuralNetwork *network, List *x, List *y){
         || !check_matrix_list(y, solver_get_layer_n_val(network->solver, solver_get_num_layers(network->solver) - 1), 1)
         || listGetSize(x) != listGetSize(y)
     ) return;
+    if(solver_is_frozen(network->solver)){
+        printf("Network is frozen for inference. Not training.\n");
+        return;
+    }
     
     //Get some values that get reused often
     const int list_size = listGetSize(x); //Constant that will most likely be used continuously.
-    Matrix *output_layer = solver_get_output_layer(network->solver);    //LIST_DER(Matrix *, listGet(network->a, listGetSize(network->a) - 1));
+    const int batch_size = network->batch_size < list_size ? network->batch_size : list_size;
+    Matrix *output_layer;
+    
+    //Samples are gathered into n x batch_size matrices so every layer runs one matrix-matrix product per batch
+    Neural_Batch x_batch, y_batch;
+    if(batch_size > 1){
+        neural_batch_create(&x_batch, LIST_DER(Matrix *, listGet(x, 0)), batch_size, list_size % batch_size);
+        neural_batch_create(&y_batch, LIST_DER(Matrix *, listGet(y, 0)), batch_size, list_size % batch_size);
+    }
     
     //Create a pile of indexes such that I can select randomly the order of inputs in each round.
     //This allows me to not have to shuffle the original List x or y, just grab the input.
@@ -129,50 +881,150 @@ void neural_network_train(NeuralNetwork *network, List *x, List *y){
     List *discard_index = listCreate(listGetSize(x), sizeof(int), NULL, NULL);
     assert(discard_index != NULL);
     
+    //Each round's (random) sample order is drawn up front so that parallel workers can split it
+    int *order = (int *) malloc(list_size * sizeof(int));
+    assert(order != NULL);
+    
     //Initialize the todo_index, filling it with listGetSize(x) indexes from [0, listGetSize(x) - 1]
     int i;
-    int j = 100;
-    for(i = 0; i < list_size; i++){
-        listAppend(todo_index, &i); //Remember it needs a pointer to the object so it needs to be the address of the number
+    int j = network->max_epochs;
+    int start = 0;  /*Samples of the first round already trained on, when resuming in the middle of one*/
+    NeuralCheckpoint *resume = network->resume;
+    network->resume = NULL;
+    if(resume == NULL){
+        for(i = 0; i < list_size; i++){
+            listAppend(todo_index, &i); //Remember it needs a pointer to the object so it needs to be the address of the number
+        }
+    }else{
+        //In the middle of a round its order has already been drawn, moving every index from the todo pile to the discard one
+        for(i = 0; i < list_size; i++){
+            listAppend(resume->position ? discard_index : todo_index, &resume->order[i]);
+        }
+        memcpy(order, resume->order, list_size * sizeof(int));
+        start = resume->position;
+        j = network->max_epochs - resume->epoch;
+        network->shuffle = resume->shuffle;
+    }
+    const int rounds = j;
+    
+    Neural_Worker *workers = NULL;
+    Neural_Pipeline *pipeline = NULL;
+    int worker_count = 0;
+    if(network->parallel == NEURAL_PARALLEL_PIPELINE){
+        pipeline = neural_pipeline_create(network, network->workers < 1 ? threadPoolGetSize() : network->workers, batch_size);
+    }else if(network->parallel != NEURAL_PARALLEL_NONE){
+        worker_count = network->workers < 1 ? threadPoolGetSize() : network->workers;
+        if(worker_count > list_size) worker_count = list_size;
+        workers = neural_workers_create(network, x, y, worker_count, batch_size);
+    }
+    
+    //The validation set goes through the same batches, in its own order
+    const int valid_size = network->valid_x != NULL
+        && check_matrix_list(network->valid_x, solver_get_layer_n_val(network->solver, 0), 1)
+        && check_matrix_list(network->valid_y, solver_get_layer_n_val(network->solver, solver_get_num_layers(network->solver) - 1), 1)
+        ? listGetSize(network->valid_x) : 0;
+    const int valid_batch = batch_size < valid_size ? batch_size : valid_size;
+    Neural_Batch valid_x_batch, valid_y_batch;
+    Matrix *best = NULL;
+    double best_loss = INFINITY;
+    int *valid_order = NULL, stale = 0;
+    if(resume != NULL){
+        best = resume->best;
+        best_loss = resume->best_loss;
+        stale = resume->stale;
+        resume->best = NULL;
+        checkpoint_clear(resume);
+        free(resume);
+    }
+    
+    //Snapshots go to disk from the writer's thread while training carries on
+    NeuralCheckpointWriter *writer = network->checkpoint != NULL ? checkpoint_writer_create(network->checkpoint) : NULL;
+    long since = 0;     /*Samples trained on since the last checkpoint*/
+    if(valid_size){
+        valid_order = (int *) malloc(valid_size * sizeof(int));
+        assert(valid_order != NULL);
+        for(i = 0; i < valid_size; i++){
+            valid_order[i] = i;
+        }
+        if(valid_batch > 1){
+            neural_batch_create(&valid_x_batch, LIST_DER(Matrix *, listGet(network->valid_x, 0)), valid_batch, valid_size % valid_batch);
+            neural_batch_create(&valid_y_batch, LIST_DER(Matrix *, listGet(network->valid_y, 0)), valid_batch, valid_size % valid_batch);
+        }
     }
     
     if(network->log) fprintf(network->logFile, "{\"Iterations\":{");
     
-    //TODO:Add max iterations and alpha checking later, defaulting to 100 rounds for now
-    do{
+    while(j > 0){
         printf("Rounds remaining: %d\n", j);
-        if(network->log) fprintf(network->logFile, "\"Iteration %d\":{\"Results\":{", 100-j);
-        for(i = 0; i < list_size; i++){
-            //Get a random index to get a specific (random) entry
-            int sel_ind = neural_list_get_random(todo_index, discard_index);
-            Matrix *x_mat = LIST_DER(Matrix *, listGet(x, sel_ind));
-            Matrix *y_mat = LIST_DER(Matrix *, listGet(y, sel_ind));
-            
-            if(network->log){
-                fprintf(network->logFile, "\"Set %d\":{\"Input\":[", sel_ind);
-                matrixPrintJSON(x_mat, network->logFile);
-            }
-            
-            //ForwardPropagate it
-            network->solver->forwardPropagate(network->solver, x_mat);
-            
-            //TODO: Get the error
+        if(network->log){
+            if(j != rounds) fprintf(network->logFile, ",");
+            fprintf(network->logFile, "\"Iteration %d\":{\"Results\":{", network->max_epochs - j);
+        }
+        
+        //Get random indexes to get specific (random) entries
+        for(i = 0; start == 0 && i < list_size; i++){
+            order[i] = neural_list_get_random(todo_index, discard_index, &network->shuffle);
+        }
+        
+        //Workers log nothing per batch, as their outputs are spread over their replicas
+        if(network->parallel == NEURAL_PARALLEL_HOGWILD){
+            Neural_Epoch epoch = {workers, x, y, order, batch_size};
+            threadPoolRun(neural_hogwild_part, &epoch, worker_count);
             
-            //Log it
-            if(network->log){
-                fprintf(network->logFile, "],\"Output\":[");
-                matrixPrintJSON(output_layer, network->logFile);
-                fprintf(network->logFile, "],\"Expected\":[");
-                matrixPrintJSON(y_mat, network->logFile);
-                fprintf(network->logFile, "]}");
-                //If I have more entries to go through this round, add a comma
-                if(i < list_size - 1){
-                    fprintf(network->logFile, ",");
+            //The workers' updates are too many to keep count of, so other processes are caught up with once per round
+            solver_average_parameters(network->solver);
+            since += list_size;
+        }else{
+            for(i = start; i < list_size; i += batch_size){
+                const int count = list_size - i < batch_size ? list_size - i : batch_size;
+                Matrix *x_mat, *y_mat;
+                
+                //Checkpoints within a round go between batches, ones falling on its end wait for the round to finish
+                if(writer != NULL && network->checkpoint_unit == NEURAL_CHECKPOINT_SAMPLES && since >= network->checkpoint_period && i > start){
+                    neural_checkpoint(network, writer, order, list_size, network->max_epochs - j, i, best, best_loss, stale);
+                    since = 0;
                 }
+                since += count;
+                
+                neural_batch_gather(&x_batch, &y_batch, x, y, order + i, count, batch_size, &x_mat, &y_mat);
+                
+                if(network->parallel == NEURAL_PARALLEL_DATA){
+                    neural_data_step(network, workers, worker_count, x_mat, y_mat);
+                    continue;
+                }
+                if(network->parallel == NEURAL_PARALLEL_PIPELINE){
+                    neural_pipeline_step(network, pipeline, x_mat, y_mat);
+                    continue;
+                }
+                
+                if(network->log){
+                    if(batch_size == 1) fprintf(network->logFile, "\"Set %d\":{\"Input\":[", order[i]);
+                    else fprintf(network->logFile, "\"Batch %d\":{\"Input\":[", i / batch_size);
+                    matrixPrintJSON(x_mat, network->logFile);
+                }
+                
+                //ForwardPropagate it
+                network->solver->forwardPropagate(network->solver, x_mat);
+                
+                //TODO: Get the error
+                
+                //Log it
+                if(network->log){
+                    output_layer = solver_get_output_layer(network->solver);
+                    fprintf(network->logFile, "],\"Output\":[");
+                    matrixPrintJSON(output_layer, network->logFile);
+                    fprintf(network->logFile, "],\"Expected\":[");
+                    matrixPrintJSON(y_mat, network->logFile);
+                    fprintf(network->logFile, "]}");
+                    //If I have more entries to go through this round, add a comma
+                    if(i + count < list_size){
+                        fprintf(network->logFile, ",");
+                    }
+                }
+                
+                //BackPropagate it
+                network->solver->backPropagate(network->solver, x_mat, y_mat);
             }
-            
-            //BackPropagate it
-            network->solver->backPropagate(network->solver, x_mat, y_mat);
         }
         
         //Reset the todo_index and discard_index
@@ -182,20 +1034,150 @@ void neural_network_train(NeuralNetwork *network, List *x, List *y){
         todo_index = temp;
         
         j--;
-        //TODO fix logging comma after while loop halt has been setMat
-        if(network->log){
-            fprintf(network->logFile, "}}"); //potential to add error here
-            if(j) fprintf(network->logFile, ",");
+        if(network->log) fprintf(network->logFile, "}");
+        
+        //Keep the best weights so far, and stop once the validation loss hasn't dropped by tolerance for patience rounds
+        if(valid_size){
+            const double loss = neural_validation_loss(network, &valid_x_batch, &valid_y_batch, valid_order, valid_batch);
+            
+            if(network->log) fprintf(network->logFile, ",\"Validation Loss\":%lf", loss);
+            if(loss < best_loss - network->tolerance || best == NULL){
+                best = solver_copy_parameters(network->solver, best);
+                best_loss = loss;
+                stale = 0;
+            }else if(++stale >= network->patience && network->patience > 0){
+                printf("Validation loss stalled at %lf. Stopping early.\n", best_loss);
+                j = 0;
+            }
+        }
+        
+        //Between rounds order is the todo pile the next one draws from
+        start = 0;
+        if(writer != NULL && (network->checkpoint_unit == NEURAL_CHECKPOINT_EPOCHS ? (network->max_epochs - j) % network->checkpoint_period == 0 : since >= network->checkpoint_period)){
+            neural_checkpoint(network, writer, order, list_size, network->max_epochs - j, 0, best, best_loss, stale);
+            since = 0;
         }
-    }while(j); //Each loop here consists of one round
+        
+        if(network->log) fprintf(network->logFile, "}");
+    } //Each loop here consists of one round
     if(network->log) fprintf(network->logFile, "}}");
+    checkpoint_writer_destroy(writer);
+    
+    if(best != NULL){
+        solver_restore_parameters(network->solver, best);
+        matrixDestroy(best, 0);
+    }
+    if(valid_size){
+        if(valid_batch > 1){
+            neural_batch_destroy(&valid_x_batch, valid_batch);
+            neural_batch_destroy(&valid_y_batch, valid_batch);
+        }
+        free(valid_order);
+    }
     
     listDestroy(todo_index);
     listDestroy(discard_index);
+    free(order);
+    if(workers != NULL) neural_workers_destroy(workers, worker_count, batch_size);
+    if(pipeline != NULL) neural_pipeline_destroy(pipeline);
+    if(batch_size > 1){
+        neural_batch_destroy(&x_batch, batch_size);
+        neural_batch_destroy(&y_batch, batch_size);
+    }
+}
+
+NeuralContext *neural_context_create(NeuralNetwork *network){
+    if(network == NULL) return NULL;
+    
+    SolverInference *inference = solver_inference_create(network->solver, NEURAL_INFERENCE_COLUMNS);
+    if(inference == NULL) return NULL;
+    
+    NeuralContext *ret = (NeuralContext *) calloc(1, sizeof(NeuralContext));
+    assert(ret != NULL);
+    ret->network = network;
+    ret->inference = inference;
+    
+    return ret;
+}
+
+void neural_context_destroy(NeuralContext *context){
+    if(context == NULL) return;
+    
+    solver_inference_destroy(context->inference);
+    free(context);
+}
+
+/**
+ * Class of every column of output: bit r is set when output node r is at least .5.
+ **/
+static void neural_output_classes(Matrix *output, int *classes){
+    const int n = matrixGetN(output), m = matrixGetM(output);
+    int r, c;
+    
+    for(c = 0; c < m; c++){
+        classes[c] = 0;
+        for(r = 0; r < n; r++){
+            if(matrixGetValue(output, r, c) >= .5) classes[c] |= 1 << r;
+        }
+    }
+}
+
+Matrix *neural_context_predict(NeuralContext *context, Matrix *input){
+    if(context == NULL || input == NULL) return NULL;
+    
+    return solver_infer(context->network->solver, context->inference, input);
+}
+
+char neural_context_classify_matrix(NeuralContext *context, Matrix *input, int *classes){
+    if(classes == NULL) return 0;
+    
+    Matrix *output = neural_context_predict(context, input);
+    if(output == NULL) return 0;
+    
+    neural_output_classes(output, classes);
+    return 1;
+}
+
+char neural_context_classify(NeuralContext *context, List *input, int *classes){
+    if(context == NULL || input == NULL || classes == NULL || listGetSize(input) == 0) return 0;
+    
+    const int list_size = listGetSize(input);
+    NeuralNetworkSolver *solver = context->network->solver;
+    int i;
+    
+    //Samples go through in chunks packed into the context's buffers
+    for(i = 0; i < list_size; i += NEURAL_INFERENCE_COLUMNS){
+        const int count = list_size - i < NEURAL_INFERENCE_COLUMNS ? list_size - i : NEURAL_INFERENCE_COLUMNS;
+        Matrix *packed = solver_inference_pack(solver, context->inference, input, i, count);
+        Matrix *output = packed == NULL ? NULL : solver_infer(solver, context->inference, packed);
+        
+        if(output == NULL) return 0;
+        
+        neural_output_classes(output, classes + i);
+    }
+    
+    return 1;
+}
+
+/**
+ * The context the network's own inference functions run in, made on first use.
+ **/
+static NeuralContext *neural_network_context(NeuralNetwork *network){
+    if(network != NULL && network->context == NULL) network->context = neural_context_create(network);
+    
+    return network == NULL ? NULL : network->context;
+}
+
+Matrix *neural_network_predict(NeuralNetwork *network, Matrix *input){
+    return neural_context_predict(neural_network_context(network), input);
+}
+
+char neural_network_classify_matrix(NeuralNetwork *network, Matrix *input, int *classes){
+    return neural_context_classify_matrix(neural_network_context(network), input, classes);
 }
 
-List *neural_network_classify(NeuralNetwork *network, List *input){
-    //TODO all of it...
+char neural_network_classify(NeuralNetwork *network, List *input, int *classes){
+    return neural_context_classify(neural_network_context(network), input, classes);
 }
 
 // void forwardPropagate(NeuralNetwork *network, Matrix *input);
@@ -110,7 +110,7 @@ Data *extractData(char *filename){
     return data;
 }
 
-int binTransform(Data *data, float low, float high){
+int binTransform(Data *data, float low, float high, char type){
     int lowF = (int)(low * data->numEntries), highF = (int)(high * data->numEntries);
     
     printf("Low: %d; High: %d\n", lowF, highF);
@@ -129,82 +129,39 @@ int binTransform(Data *data, float low, float high){
         }
         listDestroy(docFreq); //I don't need this anymore.. by now I have all the unique features that I need
         int uFeatsSize = listGetSize(data->uFeats);
-        //Replacement list
-        List *repL = listCreate(uFeatsSize, sizeof(double), NULL, NULL);
-
-        double k = 0;
-        if(repL == NULL){
+        
+        //Every entry becomes one row of a single entries x features Matrix, and data->feats holds views of those rows
+        Matrix *featMat = type == MATRIX_FLOAT32 ? matrixCreateF(data->numEntries, uFeatsSize, NULL, data->numEntries * uFeatsSize)
+                                         : matrixCreate(data->numEntries, uFeatsSize, NULL, data->numEntries * uFeatsSize);
+        if(featMat == NULL){
             printf("Error occurred in binTransform. Exiting.\n");
             exit(0);
-        }else{
-            //Each replacement list is exactly the same size so I'm just setting it to be the same size as uFeatsSize
-            for(i = 0; i < uFeatsSize; i++){
-                listAppend(repL, &k);
-            }
         }
         
         //Now replace each and every entry with a new, binary one that represents the existence of a feature or not
-        int j;
         for(i = 0; i < data->numEntries; i++){
             //Get the current entry
             Matrix *list = LIST_DER(Matrix *, listGet(data->feats, i));
             //Iterate through it
-            matrixResetIter(list);
-            
-            double value;
-            while(!isnan(value = matrixGetNext(list, -1))){
+            int j;
+            for(j = 0; j < matrixGetN(list); j++){
+                double value = matrixGetValue(list, j, 0);
                 //If the feature exists in the current list
-                //then set repL to 1 at the index in which it was found inside uFeats
+                //then set the entry's row to 1 at the index in which it was found inside uFeats
                 int index = listIndexOf(data->uFeats, &value);
                 if(index > -1){
-                    LIST_DER(double, listGet(repL, index)) = 1;
+                    matrixSetValue(featMat, i, index, 1);
                 }
             }
-            //Swap the old matrix with the new one
-            Matrix *new = matrixCreate(listGetSize(repL), 1, listGet(repL, 0), listGetSize(repL));
+            //Swap the old matrix with a view of its row
+            Matrix *new = matrixViewVector(featMat, i);
             assert(new != NULL);
             matrixDestroy(list, 0);
             listSet(data->feats, i, &new);
-            
-            //matrixPrint(new);
-            //printf("\n**********************************************************************************************\n\n");
-            
-            //reset repL to be all 0s for the next entry list
-            for(j = 0; j < uFeatsSize; j++){
-                listSet(repL, j, &k);
-            }
-            
-            /*
-            List *list = *((List **) listGet(data->feats, i));
-            for(j = 0; j < listGetSize(repL); j++){
-                if(listIndexOf(list, listGet(data->uFeats, j)) == -1){
-                    *((double *) listGet(repL, j)) = 0;
-                }else{
-                    *((double *) listGet(repL, j)) = 1;
-                }
-            }
-
-            int minSize = listGetSize(repL);
-            if(minSize > listGetSize(list)){
-                minSize = listGetSize(list);
-            }
-
-            for(j = 0; j < minSize; j++){
-                *((double *) listGet(list, j)) = *((double *) listGet(repL, j));
-            }
-
-            if(minSize < listGetSize(repL)){
-                for(;j < listGetSize(repL); j++){
-                    listAppend(list, listGet(repL, j));
-                }
-            }else{
-                int i = listGetSize(list);
-                while(i > minSize)
-                    listRemoveRet(list, --i);
-            }*/
-            
         }
-        listDestroy(repL);
+        
+        matrixDestroy(data->featMat, 0);
+        data->featMat = featMat;
     }else{
         return 0;
     }